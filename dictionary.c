@@ -28,125 +28,440 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <malloc.h>
-#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include <zlib.h>
 #include "dictionary.h"
+#include "trie.h"
 
-struct gniggle_dictionary_hash_e {
-	char *word;
-	struct gniggle_dictionary_hash_e *next;
+/* The hash table is open addressed with linear probing, and its size is
+ * always a power of two.  Each slot keeps the word's full hash, so most
+ * mismatches are rejected without looking at the word, and words short
+ * enough to fit are kept in the slot itself.  A longer word is kept in the
+ * arena, and its slot holds a zero byte where the word would start followed
+ * by a pointer to it.  A slot with a hash of zero is empty.
+ */
+#define GNIGGLE_SLOT_INLINE 12
+
+struct gniggle_dictionary_slot {
+	uint32_t hash;			/* hash of the word, or zero */
+	char word[GNIGGLE_SLOT_INLINE];	/* the word, or a pointer to it */
+};
+
+/* the table grows once this percentage of it is full, unless changed with
+ * gniggle_dictionary_set_load()
+ */
+#define GNIGGLE_DEFAULT_LOAD 75
+
+/* long words are carved out of large blocks, so deleting the dictionary is a
+ * handful of frees.
+ */
+#define GNIGGLE_ARENA_BLOCK 65536
+
+/* repeats a byte across all eight bytes of a 64 bit word */
+#define GNIGGLE_BYTES(b) (UINT64_C(0x0101010101010101) * (b))
+
+struct gniggle_dictionary_arena {
+	struct gniggle_dictionary_arena *next;	/* previous block */
+	size_t used;			/* bytes handed out from this block */
+	size_t size;			/* bytes available in this block */
 };
 
 struct gniggle_dictionary {
 	unsigned int nwords;		/* number of words loaded */
 	unsigned int gx;		/* grid width */
 	unsigned int gy;		/* grid height */
-	unsigned int hashsize;		/* number of hash buckets */
-	struct gniggle_dictionary_hash_e **hash;	/* hash table */
+	gniggle_dictionary_backend backend; /* how words are stored */
+	unsigned int nslots;		/* number of hash slots */
+	unsigned int load;		/* percentage full before growing */
+	struct gniggle_dictionary_slot *slots;	/* hash table */
+	uint32_t *sigs;			/* letter signature for each slot */
+	struct gniggle_dictionary_arena *arena;	/* storage for long words */
+	struct gniggle_trie *trie;	/* words in a trie dictionary, or the
+					 * prefix index of a hash one */
+	const char **sorted;		/* hash dictionary's words by rank */
+	void *map;			/* mapped image the trie lives in */
+	size_t maplen;			/* size of the mapped image */
+	unsigned int filterbits;	/* bits per word, or zero for none */
+	uint64_t *filter;		/* Bloom filter, built when needed */
+	unsigned int filtermask;	/* number of filter blocks - 1 */
+	unsigned int filterk;		/* bits set for each word */
+	unsigned int filtercap;		/* words the filter was sized for */
+	struct gniggle_dictionary_filter_stats stats;
+	struct gniggle_dictionary *base;	/* what an overlay lies on */
+	struct gniggle_dictionary *added;	/* words an overlay adds */
+	struct gniggle_dictionary *removed;	/* words an overlay takes away */
+	unsigned int refs;		/* references besides the creator's */
+	bool frozen;			/* read only, see freeze() */
+};
+
+/* A live dictionary is the one new games should use.  Swapping it only
+ * changes which dictionary the next caller is handed; anyone already
+ * holding the old one keeps a reference, so it goes away with the last of
+ * them.
+ */
+struct gniggle_dictionary_live {
+	pthread_mutex_t lock;		/* held only to swap or reference */
+	struct gniggle_dictionary *dict;/* the current dictionary */
 };
 
+/* reference counts are shared between threads, and change only when a game
+ * starts or ends, so one lock for all of them is plenty
+ */
+static pthread_mutex_t gniggle_dictionary_refs = PTHREAD_MUTEX_INITIALIZER;
+
+/* An overlay keeps its added and removed words in small dictionaries of their
+ * own.  No word is ever in both the base and the added words, and removed
+ * words are always in the base, so the overlay's words are simply the base's
+ * and added words less the removed ones.  Its cursors walk all three at once,
+ * with a node and a rank for each; a dead node means that dictionary has no
+ * words down this path.
+ */
+#define GNIGGLE_LAYER_BASE 0
+#define GNIGGLE_LAYER_ADDED 1
+#define GNIGGLE_LAYER_REMOVED 2
+#define GNIGGLE_LAYER_DEAD (~0u)
+
+/* The Bloom filter is split into blocks of one cache line each, and all of a
+ * word's bits are in the same block, so checking a word touches just one
+ * line.  The block is picked by the bottom bits of the word's hash, and the
+ * bits within it by stepping a generator seeded from the whole hash.
+ */
+#define GNIGGLE_FILTER_BLOCK 8		/* 64 bit words in a block */
+
+/* A mapped image is a header followed directly by the trie's node array,
+ * which is used where it lies.  All header fields are little-endian 32 bit
+ * words: the version at 8, then the number of nodes, the number of words,
+ * the length of the longest word, and the grid width and height it was
+ * built for.
+ */
+/* A dump is gzip compressed.  Version 2 dumps start with "GNIGDICT" and then
+ * little-endian 32 bit words: the version, which sections are present, the
+ * grid width and height the words were chosen for, the number of words, the
+ * size of the word text, and the length of the longest word.  The text
+ * follows, every word terminated by a zero byte, then the sections: a
+ * signature per word, and a count of words of each length up to the
+ * longest.  It ends with a CRC-32 of everything before it.  In the original
+ * format the version is instead a native-endian 0x12345678, and the words
+ * are in hash chains.
+ */
+#define GNIGGLE_DUMP_VERSION 2
+#define GNIGGLE_DUMP_HEADER 36
+
+/* the most word text a dump may hold, which keeps every size worked out
+ * from the header well within what gzread() can be asked for
+ */
+#define GNIGGLE_DUMP_MAX_TEXT (1u << 28)
+
+/* sections of a dump are read this many bytes at a time */
+#define GNIGGLE_DUMP_CHUNK (1u << 20)
+
+#define GNIGGLE_MAP_MAGIC "GNIGTRIE"
+#define GNIGGLE_MAP_VERSION 1
+#define GNIGGLE_MAP_HEADER 32
+
 struct gniggle_dictionary_iter {
 	struct gniggle_dictionary *dict;/* dictionary we're iterating */
-	unsigned int bucket;		/* current bucket */
-	struct gniggle_dictionary_hash_e *entry; /* last hash entry */	
+	unsigned int slot;		/* next slot to look at */
+	struct gniggle_trie_iter *trie;	/* iterator for trie dictionaries */
+	bool sorted;			/* iterating by rank instead */
+	unsigned int rank;		/* next rank to return */
+	unsigned int end;		/* rank to stop at */
+	char *word;			/* spelt out words for sorted tries */
+	struct gniggle_dictionary_iter *inner;	/* an overlay's base, then its
+						 * added words */
+	bool second;			/* inner is on the added words */
 };
 
-char *gniggle_dictionary_trim_qu(const char *word)
+size_t gniggle_dictionary_trim_qu_into(const char *word, char *out)
 {
-	size_t i, len = strlen(word);
-	char *r = calloc(len + 1, 1);
-	char *p = r;
-	
-	for (i = 0; i < strlen(word); i++) {
-		*p++ = word[i];
-		if (word[i] == 'q')
-			i++;
+	char *p = out;
+
+	for (; *word != '\0'; word++) {
+		*p++ = *word;
+		if (*word == 'q' && word[1] != '\0')
+			word++;
 	}
-	
+	*p = '\0';
+
+	return p - out;
+}
+
+size_t gniggle_dictionary_restore_qu_into(const char *word, char *out)
+{
+	char *p = out;
+
+	for (; *word != '\0'; word++) {
+		*p++ = *word;
+		if (*word == 'q')
+			*p++ = 'u';
+	}
+	*p = '\0';
+
+	return p - out;
+}
+
+char *gniggle_dictionary_trim_qu(const char *word)
+{
+	char *r = malloc(strlen(word) + 1);
+
+	gniggle_dictionary_trim_qu_into(word, r);
+
 	return r;
 }
 
 char *gniggle_dictionary_restore_qu(const char *word)
 {
-	size_t qs = 0, i;
-	char *r;
-	char *b;
-	
-	for (i = 0; i < strlen(word); i++)
-		if (word[i] == 'q')
-			qs++;
-	
-	if (qs == 0)
-		return strdup(word);
-	
-	r = calloc(strlen(word) + qs + 1, 1);
-	
-	b = r;
-	for (i = 0; i < strlen(word); i++) {
-		*b = word[i];
-		if (*b == 'q') {
-			*(b + 1) = 'u';
-			b++;
-		}
-		b++;
-	}
-	
+	char *r = malloc(strlen(word) * 2 + 1);
+
+	gniggle_dictionary_restore_qu_into(word, r);
+
 	return r;
 }
 
-bool gniggle_dictionary_word_qualifies(const char *word, 
-					const int maxlen)
+/* returns true if all eight bytes of 'v' are lower-case letters other than
+ * Q, which is the usual case for a chunk of a word and can be copied as it
+ * is.  Anything else is left to the byte-at-a-time path.
+ */
+static bool gniggle_dictionary_plain8(uint64_t v)
 {
-	char *qu;
-	int i, len = strlen(word);
-	
+	const uint64_t high = GNIGGLE_BYTES(0x80);
+	uint64_t atleast_a, above_z, q;
+
+	if ((v & high) != 0)
+		return false;
+
+	/* with the top bits clear, adding to each byte cannot carry into the
+	 * next, so the top bit of each sum says which side of the letter's
+	 * range the byte is on
+	 */
+	atleast_a = v + GNIGGLE_BYTES(0x80 - 'a');
+	above_z = v + GNIGGLE_BYTES(0x7f - 'z');
+	if ((atleast_a & ~above_z & high) != high)
+		return false;
+
+	/* a byte of the exclusive or is zero where there was a Q */
+	q = v ^ GNIGGLE_BYTES('q');
+	return ((q - GNIGGLE_BYTES(0x01)) & ~q & high) == 0;
+}
+
+int gniggle_dictionary_normalise_into(const char *word, size_t len,
+					char *out, const unsigned int maxlen)
+{
+	size_t i = 0;
+	unsigned int o = 0;
+	uint64_t v;
+
 	/* Word is at least three characters long */
 	if (len < 3)
-		return false;
-		
-	/* Word is entirely lower-case */
-	for (i = 0; i < len; i++)
-		if (isupper(word[i]))
-			return false;
-			
-	/* If word contains a Q, it is followed by a U */
-	for (i = 0; i < len; i++)
-		if (word[i] == 'q' && word[i + 1] != 'u')
-			return false;
-			
-	/* Word is made up only of letters (no punctuation) */
-	for (i = 0; i < len; i++)
-		if (isalpha(word[i]) == 0)
-			return false;
-	
-	/* Convert qu to just q when considering other tests */
-	qu = gniggle_dictionary_trim_qu(word);
-	len = strlen(qu);
-	free(qu);
-		
+		return -1;
+
+	while (i < len) {
+		if (len - i >= 8) {
+			memcpy(&v, word + i, 8);
+			if (gniggle_dictionary_plain8(v) == true) {
+				if (out != NULL)
+					memcpy(out + o, &v, 8);
+				i += 8;
+				o += 8;
+				continue;
+			}
+		}
+
+		/* Word is made up only of lower-case letters */
+		if (word[i] < 'a' || word[i] > 'z')
+			return -1;
+		if (out != NULL)
+			out[o] = word[i];
+		o++;
+
+		/* If word contains a Q, it is followed by a U, and the two
+		 * count as one letter from here on
+		 */
+		if (word[i] == 'q') {
+			if (i + 1 == len || word[i + 1] != 'u')
+				return -1;
+			i++;
+		}
+		i++;
+	}
+
 	/* Word is not longer than the maximum length (which is the total
 	 * number of letters on the board, if by some marvel they can all be
 	 * be used to spell a word
 	 */
-	if (len > maxlen)
+	if (o > maxlen)
+		return -1;
+
+	if (out != NULL)
+		out[o] = '\0';
+	return o;
+}
+
+bool gniggle_dictionary_word_qualifies(const char *word, 
+					const int maxlen)
+{
+	if (maxlen < 0)
 		return false;
-	
-	return true;	
+
+	return gniggle_dictionary_normalise_into(word, strlen(word), NULL,
+							maxlen) != -1;
+}
+
+unsigned int gniggle_dictionary_signature(const char *word)
+{
+	unsigned int r = 0;
+
+	for (; *word != '\0'; word++)
+		if (*word >= 'a' && *word <= 'z')
+			r |= 1 << (*word - 'a');
+
+	return r;
+}
+
+static uint32_t gniggle_dictionary_hash(const char *word, size_t *len)
+{
+	const unsigned char *p = (const unsigned char *)word;
+	uint32_t h = 0x811c9dc5;
+
+	while (*p != '\0') {
+		h ^= *p++;
+		h *= 0x01000193;
+	}
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	*len = (const char *)p - word;
+
+	return (h == 0) ? 1 : h;
+}
+
+/* returns the word held by, or pointed to by, a slot */
+static const char *gniggle_dictionary_slot_word(
+				const struct gniggle_dictionary_slot *slot)
+{
+	const char *r;
+
+	if (slot->word[0] != '\0')
+		return slot->word;
+
+	memcpy(&r, slot->word + sizeof(uint32_t), sizeof(r));
+	return r;
+}
+
+/* returns a copy of 'word' allocated from the dictionary's arena */
+static char *gniggle_dictionary_arena_copy(struct gniggle_dictionary *dict,
+				const char *word, size_t len)
+{
+	struct gniggle_dictionary_arena *a = dict->arena;
+	char *r;
+
+	if (a == NULL || a->used + len + 1 > a->size) {
+		size_t size = (len + 1 > GNIGGLE_ARENA_BLOCK) ? len + 1 :
+						GNIGGLE_ARENA_BLOCK;
+		a = malloc(sizeof(struct gniggle_dictionary_arena) + size);
+		a->next = dict->arena;
+		a->used = 0;
+		a->size = size;
+		dict->arena = a;
+	}
+
+	r = (char *)(a + 1) + a->used;
+	a->used += len + 1;
+
+	memcpy(r, word, len);
+	r[len] = '\0';
+
+	return r;
+}
+
+/* makes sure the arena has 'size' bytes free in one block, so that a known
+ * amount of long words can be added without allocating as they go
+ */
+static void gniggle_dictionary_arena_reserve(struct gniggle_dictionary *dict,
+				size_t size)
+{
+	struct gniggle_dictionary_arena *a = dict->arena;
+
+	if (size == 0 || (a != NULL && a->used + size <= a->size))
+		return;
+
+	a = malloc(sizeof(struct gniggle_dictionary_arena) + size);
+	a->next = dict->arena;
+	a->used = 0;
+	a->size = size;
+	dict->arena = a;
+}
+
+/* returns the slot holding 'word', or the empty slot where it would go */
+static struct gniggle_dictionary_slot *gniggle_dictionary_probe(
+				struct gniggle_dictionary *dict,
+				const char *word, uint32_t hash, size_t len)
+{
+	unsigned int mask = dict->nslots - 1;
+	unsigned int i = hash & mask;
+
+	while (dict->slots[i].hash != 0) {
+		struct gniggle_dictionary_slot *s = &dict->slots[i];
+		if (s->hash == hash) {
+			if (len < GNIGGLE_SLOT_INLINE) {
+				if (strcmp(s->word, word) == 0)
+					return s;
+			} else if (s->word[0] == '\0' && strcmp(
+				gniggle_dictionary_slot_word(s), word) == 0) {
+				return s;
+			}
+		}
+		i = (i + 1) & mask;
+	}
+
+	return &dict->slots[i];
 }
 
-unsigned int gniggle_dictionary_fnv(const char *word)
+/* makes sure there is room for 'nwords' words without the table going
+ * over its load factor, moving every word to a bigger table if needed.  The
+ * sorted index points into the table, so it goes if the table moves.
+ */
+static void gniggle_dictionary_reserve(struct gniggle_dictionary *dict,
+				unsigned int nwords)
 {
-	unsigned int z = 0x01000193;
+	struct gniggle_dictionary_slot *old = dict->slots;
+	uint32_t *oldsigs = dict->sigs;
+	unsigned int oldsize = dict->nslots, size = 16, i;
 
-	if (word == NULL)
-		return 0;
+	while ((unsigned long)size * dict->load < (unsigned long)nwords * 100)
+		size <<= 1;
 
-	while (*word) {
-		z *= 0x01000193;
-		z ^= *word++;
+	if (size <= oldsize)
+		return;
+
+	dict->slots = calloc(sizeof(struct gniggle_dictionary_slot), size);
+	dict->sigs = calloc(sizeof(uint32_t), size);
+	dict->nslots = size;
+
+	for (i = 0; i < oldsize; i++) {
+		unsigned int j;
+		if (old[i].hash == 0)
+			continue;
+		j = old[i].hash & (size - 1);
+		while (dict->slots[j].hash != 0)
+			j = (j + 1) & (size - 1);
+		dict->slots[j] = old[i];
+		dict->sigs[j] = oldsigs[i];
 	}
 
-	return z;
+	free(old);
+	free(oldsigs);
+
+	free(dict->sorted);
+	dict->sorted = NULL;
 }
 
 struct gniggle_dictionary *gniggle_dictionary_new(const unsigned int x,
@@ -157,170 +472,1374 @@ struct gniggle_dictionary *gniggle_dictionary_new(const unsigned int x,
 						1);
 	r->gx = x;
 	r->gy = y;
-	r->hashsize = (hashsize == 0) ? 7919 : hashsize;
-	r->hash = calloc(sizeof(struct gniggle_dictionary_hash_e **),
-			r->hashsize);
+	r->backend = gniggle_backend_hash;
+	r->load = GNIGGLE_DEFAULT_LOAD;
+	gniggle_dictionary_reserve(r, hashsize);
 	
 	return r;	
 }
 
+void gniggle_dictionary_set_load(struct gniggle_dictionary *dict,
+					const unsigned int percent)
+{
+	if (dict->backend != gniggle_backend_hash || dict->frozen == true)
+		return;
+
+	dict->load = percent < 10 ? 10 : (percent > 95 ? 95 : percent);
+	gniggle_dictionary_reserve(dict, dict->nwords);
+}
+
+struct gniggle_dictionary *gniggle_dictionary_new_trie(const unsigned int x,
+					const unsigned int y)
+{
+	struct gniggle_dictionary *r = calloc(sizeof(struct gniggle_dictionary),
+						1);
+	r->gx = x;
+	r->gy = y;
+	r->backend = gniggle_backend_trie;
+	r->trie = gniggle_trie_new();
+
+	return r;
+}
+
+gniggle_dictionary_backend gniggle_dictionary_get_backend(
+					struct gniggle_dictionary *dict)
+{
+	return dict->backend;
+}
+
+struct gniggle_dictionary *gniggle_dictionary_ref(
+					struct gniggle_dictionary *dict)
+{
+	pthread_mutex_lock(&gniggle_dictionary_refs);
+	dict->refs++;
+	pthread_mutex_unlock(&gniggle_dictionary_refs);
+
+	return dict;
+}
+
 void gniggle_dictionary_delete(struct gniggle_dictionary *dict)
 {
-	unsigned int i;
-	
-	for (i = 0; i < dict->hashsize; i++) {
-		struct gniggle_dictionary_hash_e *e = dict->hash[i];
-		while (e != NULL) {
-			struct gniggle_dictionary_hash_e *n = e;
-			free(e->word);
-			e = e->next;
-			free(n);
-		}	
+	bool shared;
+
+	pthread_mutex_lock(&gniggle_dictionary_refs);
+	shared = dict->refs > 0;
+	if (shared == true)
+		dict->refs--;
+	pthread_mutex_unlock(&gniggle_dictionary_refs);
+
+	if (shared == true)
+		return;
+
+	if (dict->backend == gniggle_backend_overlay) {
+		gniggle_dictionary_delete(dict->added);
+		gniggle_dictionary_delete(dict->removed);
+		gniggle_dictionary_delete(dict->base);
+	}
+	if (dict->trie != NULL)
+		gniggle_trie_delete(dict->trie);
+	if (dict->map != NULL)
+		munmap(dict->map, dict->maplen);
+
+	while (dict->arena != NULL) {
+		struct gniggle_dictionary_arena *a = dict->arena;
+		dict->arena = a->next;
+		free(a);
 	}
 	
-	free(dict->hash);
+	free(dict->slots);
+	free(dict->sigs);
+	free(dict->sorted);
+	free(dict->filter);
 	free(dict);
 }
 
-void gniggle_dictionary_add(struct gniggle_dictionary *dict,
-				const char *word)
+static void gniggle_dictionary_filter_add(struct gniggle_dictionary *dict,
+				uint32_t hash)
 {
-	char *nqu;
-	
-	if (gniggle_dictionary_word_qualifies(word, dict->gx * dict->gy)
-		== false)
-		return;
-		
-	nqu = gniggle_dictionary_trim_qu(word);
-	
-	if (gniggle_dictionary_lookup(dict, nqu) == false) {
-		struct gniggle_dictionary_hash_e *e = calloc(
-				sizeof(struct gniggle_dictionary_hash_e), 1);
-		unsigned int hash = gniggle_dictionary_fnv(nqu);
-		unsigned int bucket = hash % (dict->hashsize);
-		
-		e->word = nqu;
-		e->next = dict->hash[bucket];
-		dict->hash[bucket] = e;
-		dict->nwords++;
-	} else {
-		free(nqu);
+	uint64_t *block = dict->filter +
+			(hash & dict->filtermask) * GNIGGLE_FILTER_BLOCK;
+	uint32_t x = hash;
+	unsigned int i;
+
+	for (i = 0; i < dict->filterk; i++) {
+		x = x * 0x2c1b3c6d + 0x297a2d39;
+		block[(x >> 29)] |= (uint64_t)1 << ((x >> 23) & 63);
 	}
 }
-				
-bool gniggle_dictionary_lookup(struct gniggle_dictionary *dict,
-				const char *word)
+
+/* returns false if the word with this hash is definitely not present */
+static bool gniggle_dictionary_filter_test(struct gniggle_dictionary *dict,
+				uint32_t hash)
 {
-	unsigned int hash = gniggle_dictionary_fnv(word);
-	unsigned int bucket = hash % (dict->hashsize);
-	
-	struct gniggle_dictionary_hash_e *e = dict->hash[bucket];
-	
-	while (e != NULL) {
-		if (strcmp(word, e->word) == 0)
-			return true;
-		e = e->next;
+	const uint64_t *block = dict->filter +
+			(hash & dict->filtermask) * GNIGGLE_FILTER_BLOCK;
+	uint32_t x = hash;
+	unsigned int i;
+
+	for (i = 0; i < dict->filterk; i++) {
+		x = x * 0x2c1b3c6d + 0x297a2d39;
+		if ((block[(x >> 29)] & ((uint64_t)1 << ((x >> 23) & 63))) == 0)
+			return false;
 	}
-	
-	return false;
+
+	return true;
 }
 
-unsigned int gniggle_dictionary_size(struct gniggle_dictionary *dict)
+/* builds the filter from every word in the dictionary, with room for it to
+ * double in size before it has to be built again
+ */
+static void gniggle_dictionary_filter_build(struct gniggle_dictionary *dict)
 {
-	return dict->nwords;
+	struct gniggle_dictionary_iter *iter;
+	const char *word;
+	unsigned long bits;
+	unsigned int blocks = 1;
+
+	dict->filtercap = (dict->nwords < 1024) ? 2048 : dict->nwords * 2;
+	bits = (unsigned long)dict->filtercap * dict->filterbits;
+	while ((unsigned long)blocks * GNIGGLE_FILTER_BLOCK * 64 < bits)
+		blocks <<= 1;
+
+	/* the best number of bits per word is ln 2 times the bits there are
+	 * for each word, which is about 9/13
+	 */
+	dict->filterk = (dict->filterbits * 9 + 6) / 13;
+	if (dict->filterk < 1)
+		dict->filterk = 1;
+	if (dict->filterk > 16)
+		dict->filterk = 16;
+
+	dict->filtermask = blocks - 1;
+	dict->filter = calloc(sizeof(uint64_t) * GNIGGLE_FILTER_BLOCK, blocks);
+
+	iter = gniggle_dictionary_iterator(dict);
+	while ((word = gniggle_dictionary_next(iter)) != NULL) {
+		size_t len;
+		gniggle_dictionary_filter_add(dict,
+			gniggle_dictionary_hash(word, &len));
+	}
+	gniggle_dictionary_iterator_delete(iter);
 }
-	
-struct gniggle_dictionary_iter *gniggle_dictionary_iterator(
-				struct gniggle_dictionary *dict)
+
+void gniggle_dictionary_set_filter(struct gniggle_dictionary *dict,
+				const unsigned int bits)
 {
-	struct gniggle_dictionary_iter *r = calloc(
-				sizeof(struct gniggle_dictionary_iter), 1);
-	
-	r->dict = dict;
-	r->bucket = 0;
-	r->entry = dict->hash[0];
-	
-	return r;
+	if (dict->frozen == true)
+		return;
+
+	free(dict->filter);
+	dict->filter = NULL;
+	dict->filterbits = (bits > 64) ? 64 : bits;
+	memset(&dict->stats, 0, sizeof(dict->stats));
 }
-			
-const char *gniggle_dictionary_next(struct gniggle_dictionary_iter *iter)
+
+void gniggle_dictionary_filter_stats(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_filter_stats *stats)
 {
-	const char *r;
-	while (iter->entry == NULL) {
-		iter->bucket += 1;
-		if (iter->bucket == iter->dict->hashsize)
-			return NULL;
-		iter->entry = iter->dict->hash[iter->bucket];
+	*stats = dict->stats;
+}
+
+/* keeps the filter up to date with a newly added word, or throws it away
+ * to be built again if it has grown too full
+ */
+static void gniggle_dictionary_filter_update(struct gniggle_dictionary *dict,
+				uint32_t hash)
+{
+	if (dict->filter == NULL)
+		return;
+
+	if (dict->nwords > dict->filtercap) {
+		free(dict->filter);
+		dict->filter = NULL;
+	} else {
+		gniggle_dictionary_filter_add(dict, hash);
 	}
-	
-	r = iter->entry->word;
-	iter->entry = iter->entry->next;
-	return r;
 }
 
-void gniggle_dictionary_iterator_delete(struct gniggle_dictionary_iter *iter)
+/* adds a word that has already been checked and had its "qu"s trimmed,
+ * along with its letter signature.  Hash dictionaries return their copy of
+ * the word, which stays put until the table next grows.
+ */
+static const char *gniggle_dictionary_insert_signed(
+				struct gniggle_dictionary *dict,
+				const char *nqu, uint32_t sig)
+{
+	struct gniggle_dictionary_slot *slot;
+	uint32_t hash;
+	size_t len;
+
+	if (dict->backend == gniggle_backend_trie) {
+		if (gniggle_trie_add(dict->trie, nqu) == true) {
+			dict->nwords++;
+			gniggle_dictionary_filter_update(dict,
+				gniggle_dictionary_hash(nqu, &len));
+		}
+		return NULL;
+	}
+
+	/* only make room once the word is known to be new, so that adding a
+	 * word already there never moves the table
+	 */
+	hash = gniggle_dictionary_hash(nqu, &len);
+	slot = gniggle_dictionary_probe(dict, nqu, hash, len);
+	if (slot->hash == 0) {
+		unsigned int nslots = dict->nslots;
+		gniggle_dictionary_reserve(dict, dict->nwords + 1);
+		if (dict->nslots != nslots)
+			slot = gniggle_dictionary_probe(dict, nqu, hash, len);
+	}
+
+	if (slot->hash == 0) {
+		slot->hash = hash;
+		if (len < GNIGGLE_SLOT_INLINE) {
+			memcpy(slot->word, nqu, len + 1);
+		} else {
+			char *w = gniggle_dictionary_arena_copy(dict, nqu, len);
+			slot->word[0] = '\0';
+			memcpy(slot->word + sizeof(uint32_t), &w, sizeof(w));
+		}
+		dict->sigs[slot - dict->slots] = sig;
+		dict->nwords++;
+		gniggle_dictionary_filter_update(dict, hash);
+
+		/* the prefix index takes the word too, which throws away
+		 * its counts, but the ranks in the sorted index are stale
+		 */
+		if (dict->trie != NULL)
+			gniggle_trie_add(dict->trie, nqu);
+		free(dict->sorted);
+		dict->sorted = NULL;
+	}
+
+	return gniggle_dictionary_slot_word(slot);
+}
+
+static void gniggle_dictionary_overlay_add(struct gniggle_dictionary *dict,
+				const char *nqu);
+
+/* adds a word that has already been checked and had its "qu"s trimmed */
+static void gniggle_dictionary_insert(struct gniggle_dictionary *dict,
+				const char *nqu)
+{
+	if (dict->backend == gniggle_backend_overlay)
+		gniggle_dictionary_overlay_add(dict, nqu);
+	else
+		gniggle_dictionary_insert_signed(dict, nqu,
+				gniggle_dictionary_signature(nqu));
+}
+
+void gniggle_dictionary_add(struct gniggle_dictionary *dict,
+				const char *word)
+{
+	char stack[GNIGGLE_WORD_STACK], *nqu = stack;
+	size_t len = strlen(word);
+
+	/* every letter but a Q's U counts, so a word can't be any longer
+	 * than this and still fit
+	 */
+	if (len > 2 * dict->gx * dict->gy || dict->frozen == true)
+		return;
+
+	if (len >= sizeof(stack))
+		nqu = malloc(len + 1);
+
+	if (gniggle_dictionary_normalise_into(word, len, nqu,
+					dict->gx * dict->gy) != -1)
+		gniggle_dictionary_insert(dict, nqu);
+
+	if (nqu != stack)
+		free(nqu);
+}
+
+/* takes a word out of a hash table.  Later words in the same run of full
+ * slots are moved back to fill the gap if it lies between them and where
+ * they would rather be, so that probing still finds them.
+ */
+static bool gniggle_dictionary_unhash(struct gniggle_dictionary *dict,
+				const char *nqu)
+{
+	unsigned int mask = dict->nslots - 1, i, j;
+	uint32_t hash;
+	size_t len;
+
+	hash = gniggle_dictionary_hash(nqu, &len);
+	i = gniggle_dictionary_probe(dict, nqu, hash, len) - dict->slots;
+	if (dict->slots[i].hash == 0)
+		return false;
+
+	dict->slots[i].hash = 0;
+	for (j = (i + 1) & mask; dict->slots[j].hash != 0; j = (j + 1) & mask) {
+		unsigned int home = dict->slots[j].hash & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			dict->slots[i] = dict->slots[j];
+			dict->sigs[i] = dict->sigs[j];
+			dict->slots[j].hash = 0;
+			i = j;
+		}
+	}
+
+	if (dict->trie != NULL)
+		gniggle_trie_remove(dict->trie, nqu);
+	free(dict->sorted);
+	dict->sorted = NULL;
+
+	return true;
+}
+
+/* removes a word that has already had its "qu"s trimmed */
+static bool gniggle_dictionary_take(struct gniggle_dictionary *dict,
+				const char *nqu)
+{
+	bool r;
+
+	switch (dict->backend) {
+	case gniggle_backend_trie:
+		r = gniggle_trie_remove(dict->trie, nqu);
+		break;
+	case gniggle_backend_overlay:
+		if (gniggle_dictionary_take(dict->added, nqu) == true) {
+			r = true;
+		} else {
+			r = gniggle_dictionary_lookup(dict->base, nqu) &&
+				gniggle_dictionary_lookup(dict->removed, nqu)
+					== false;
+			if (r == true)
+				gniggle_dictionary_insert(dict->removed, nqu);
+		}
+		break;
+	default:
+		r = gniggle_dictionary_unhash(dict, nqu);
+		break;
+	}
+
+	if (r == true)
+		dict->nwords--;
+
+	return r;
+}
+
+bool gniggle_dictionary_remove(struct gniggle_dictionary *dict,
+				const char *word)
+{
+	char stack[GNIGGLE_WORD_STACK], *nqu = stack;
+	size_t len = strlen(word);
+	bool r;
+
+	if (dict->frozen == true)
+		return false;
+
+	if (len >= sizeof(stack))
+		nqu = malloc(len + 1);
+
+	gniggle_dictionary_trim_qu_into(word, nqu);
+	r = gniggle_dictionary_take(dict, nqu);
+
+	if (nqu != stack)
+		free(nqu);
+
+	return r;
+}
+
+static void gniggle_dictionary_overlay_add(struct gniggle_dictionary *dict,
+				const char *nqu)
+{
+	unsigned int before = dict->added->nwords;
+	size_t len;
+
+	if (gniggle_dictionary_take(dict->removed, nqu) == false) {
+		if (gniggle_dictionary_lookup(dict->base, nqu) == true)
+			return;
+		gniggle_dictionary_insert(dict->added, nqu);
+		if (dict->added->nwords == before)
+			return;
+	}
+
+	dict->nwords++;
+	gniggle_dictionary_filter_update(dict,
+			gniggle_dictionary_hash(nqu, &len));
+}
+
+/* returns a trie dictionary with a copy of every word in an overlay, for
+ * the few things that need all the words in one trie
+ */
+static struct gniggle_dictionary *gniggle_dictionary_flatten(
+				struct gniggle_dictionary *dict)
+{
+	struct gniggle_dictionary *r = gniggle_dictionary_new_trie(dict->gx,
+								dict->gy);
+	struct gniggle_dictionary_iter *iter = gniggle_dictionary_iterator(dict);
+	const char *word;
+
+	while ((word = gniggle_dictionary_next(iter)) != NULL)
+		gniggle_dictionary_insert(r, word);
+	gniggle_dictionary_iterator_delete(iter);
+
+	gniggle_trie_minimise(r->trie);
+
+	return r;
+}
+				
+/* asks the dictionary's filter, if it has one, about a word, counting the
+ * answer.  Returns true if the word is certainly not in the dictionary.  If
+ * the word had to be hashed, 'hash' and 'len' are set.
+ */
+static bool gniggle_dictionary_filter_rejects(struct gniggle_dictionary *dict,
+				const char *word, uint32_t *hash, size_t *len)
+{
+	if (dict->filterbits == 0)
+		return false;
+
+	/* a frozen dictionary's filter is already built, and its counts are
+	 * left alone so that lookups write nothing at all
+	 */
+	if (dict->filter == NULL)
+		gniggle_dictionary_filter_build(dict);
+
+	*hash = gniggle_dictionary_hash(word, len);
+	if (dict->frozen == false)
+		dict->stats.lookups++;
+	if (gniggle_dictionary_filter_test(dict, *hash) == false) {
+		if (dict->frozen == false)
+			dict->stats.rejected++;
+		return true;
+	}
+
+	return false;
+}
+
+bool gniggle_dictionary_lookup(struct gniggle_dictionary *dict,
+				const char *word)
+{
+	uint32_t hash = 0;
+	size_t len;
+	bool r;
+	
+	if (word[0] == '\0')
+		return false;
+
+	if (gniggle_dictionary_filter_rejects(dict, word, &hash, &len) == true)
+		return false;
+
+	if (dict->backend == gniggle_backend_trie) {
+		r = gniggle_trie_lookup(dict->trie, word);
+	} else if (dict->backend == gniggle_backend_overlay) {
+		r = gniggle_dictionary_lookup(dict->added, word) ||
+			(gniggle_dictionary_lookup(dict->removed, word) == false
+			&& gniggle_dictionary_lookup(dict->base, word));
+	} else {
+		if (hash == 0)
+			hash = gniggle_dictionary_hash(word, &len);
+		r = gniggle_dictionary_probe(dict, word, hash, len)->hash != 0;
+	}
+
+	if (dict->filterbits != 0 && r == false && dict->frozen == false)
+		dict->stats.false_positives++;
+
+	return r;
+}
+
+/* returns the trie holding every word in the dictionary, with its words
+ * counted so that they can be ranked.  For hash dictionaries this is an
+ * index that is built the first time it is needed.
+ */
+static struct gniggle_trie *gniggle_dictionary_prefix_index(
+				struct gniggle_dictionary *dict)
+{
+	if (dict->trie == NULL) {
+		struct gniggle_dictionary_iter *iter;
+		const char *word;
+
+		dict->trie = gniggle_trie_new();
+		iter = gniggle_dictionary_iterator(dict);
+		while ((word = gniggle_dictionary_next(iter)) != NULL)
+			gniggle_trie_add(dict->trie, word);
+		gniggle_dictionary_iterator_delete(iter);
+		gniggle_trie_minimise(dict->trie);
+	}
+
+	gniggle_trie_count(dict->trie);
+
+	return dict->trie;
+}
+
+void gniggle_dictionary_cursor_init(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_cursor *cursor)
+{
+	memset(cursor, 0, sizeof(*cursor));
+
+	/* make sure the indexes exist now, rather than part way through a
+	 * walk
+	 */
+	if (dict->backend == gniggle_backend_overlay) {
+		gniggle_dictionary_prefix_index(dict->base);
+		gniggle_dictionary_prefix_index(dict->added);
+		gniggle_dictionary_prefix_index(dict->removed);
+	} else {
+		gniggle_dictionary_prefix_index(dict);
+	}
+}
+
+/* returns how many words begin with the letters a cursor has walked */
+static unsigned int gniggle_dictionary_cursor_count(
+				struct gniggle_dictionary *dict,
+				const struct gniggle_dictionary_cursor *cursor)
+{
+	unsigned int r = 0, i;
+
+	if (dict->backend != gniggle_backend_overlay)
+		return gniggle_trie_words_from(dict->trie, cursor->node);
+
+	for (i = 0; i < 3; i++) {
+		unsigned int n = cursor->layer[i][0], w;
+		struct gniggle_dictionary *l = (i == GNIGGLE_LAYER_BASE) ?
+			dict->base : (i == GNIGGLE_LAYER_ADDED) ?
+			dict->added : dict->removed;
+		if (n == GNIGGLE_LAYER_DEAD)
+			continue;
+		w = gniggle_trie_words_from(l->trie, n);
+		if (i == GNIGGLE_LAYER_REMOVED)
+			r -= w;
+		else
+			r += w;
+	}
+
+	return r;
+}
+
+/* steps every layer of an overlay's cursor, failing only if none of the
+ * overlay's words carry on that way
+ */
+static bool gniggle_dictionary_overlay_step(struct gniggle_dictionary *dict,
+				const struct gniggle_dictionary_cursor *from,
+				const char letter,
+				struct gniggle_dictionary_cursor *to)
+{
+	struct gniggle_dictionary_cursor next;
+	struct gniggle_dictionary *layer[3];
+	unsigned int i, skip;
+
+	layer[GNIGGLE_LAYER_BASE] = dict->base;
+	layer[GNIGGLE_LAYER_ADDED] = dict->added;
+	layer[GNIGGLE_LAYER_REMOVED] = dict->removed;
+
+	next = *from;
+	for (i = 0; i < 3; i++) {
+		unsigned int n = next.layer[i][0];
+		if (n == GNIGGLE_LAYER_DEAD)
+			continue;
+		n = gniggle_trie_step(layer[i]->trie, n, letter, &skip);
+		next.layer[i][0] = (n == 0) ? GNIGGLE_LAYER_DEAD : n;
+		next.layer[i][1] += skip;
+	}
+
+	if (gniggle_dictionary_cursor_count(dict, &next) == 0)
+		return false;
+
+	next.rank = next.layer[GNIGGLE_LAYER_BASE][1] +
+			next.layer[GNIGGLE_LAYER_ADDED][1] -
+			next.layer[GNIGGLE_LAYER_REMOVED][1];
+	*to = next;
+
+	return true;
+}
+
+bool gniggle_dictionary_cursor_step(struct gniggle_dictionary *dict,
+				const struct gniggle_dictionary_cursor *from,
+				const char letter,
+				struct gniggle_dictionary_cursor *to)
+{
+	unsigned int n, skip;
+
+	if (dict->backend == gniggle_backend_overlay)
+		return gniggle_dictionary_overlay_step(dict, from, letter, to);
+
+	n = gniggle_trie_step(dict->trie, from->node, letter, &skip);
+	if (n == 0)
+		return false;
+
+	to->rank = from->rank + skip;
+	to->node = n;
+	return true;
+}
+
+/* returns true if the given layer of an overlay cursor is at a word */
+#define LAYER_WORD(dict, cursor, l) \
+	((cursor)->layer[l][0] != GNIGGLE_LAYER_DEAD && \
+	gniggle_trie_terminal((dict)->trie, (cursor)->layer[l][0]))
+
+bool gniggle_dictionary_cursor_word(struct gniggle_dictionary *dict,
+				const struct gniggle_dictionary_cursor *cursor)
+{
+	/* callers index arrays of nwords by rank, which a damaged image
+	 * could otherwise take past the end
+	 */
+	if (cursor->rank >= dict->nwords)
+		return false;
+
+	if (dict->backend == gniggle_backend_overlay)
+		return LAYER_WORD(dict->added, cursor, GNIGGLE_LAYER_ADDED) ||
+			(LAYER_WORD(dict->base, cursor, GNIGGLE_LAYER_BASE) &&
+			LAYER_WORD(dict->removed, cursor,
+				GNIGGLE_LAYER_REMOVED) == false);
+
+	return gniggle_trie_terminal(dict->trie, cursor->node);
+}
+
+/* spells out the overlay word with the given rank, the same way
+ * gniggle_trie_word() does but counting words in all three layers
+ */
+static void gniggle_dictionary_overlay_word(struct gniggle_dictionary *dict,
+				unsigned int rank, char *word)
+{
+	struct gniggle_dictionary_cursor c, next;
+	char letter;
+
+	gniggle_dictionary_cursor_init(dict, &c);
+
+	for (;;) {
+		if (gniggle_dictionary_cursor_word(dict, &c) == true) {
+			if (rank == 0)
+				break;
+			rank--;
+		}
+
+		for (letter = 'a'; letter <= 'z'; letter++) {
+			unsigned int here;
+			if (gniggle_dictionary_overlay_step(dict, &c, letter,
+				&next) == false)
+				continue;
+			here = gniggle_dictionary_cursor_count(dict, &next);
+			if (rank < here)
+				break;
+			rank -= here;
+		}
+
+		if (letter > 'z')
+			break;
+
+		*word++ = letter;
+		c = next;
+	}
+
+	*word = '\0';
+}
+
+unsigned int gniggle_dictionary_maxlen(struct gniggle_dictionary *dict)
+{
+	unsigned int a, b;
+
+	if (dict->backend != gniggle_backend_overlay)
+		return gniggle_trie_maxlen(
+			gniggle_dictionary_prefix_index(dict));
+
+	a = gniggle_dictionary_maxlen(dict->base);
+	b = gniggle_dictionary_maxlen(dict->added);
+
+	return (a > b) ? a : b;
+}
+
+/* returns a hash dictionary's words in alphabetical order, each pointing at
+ * the copy in its slot.  The prefix index already visits them in that
+ * order, so it is just a matter of finding each one.
+ */
+static const char **gniggle_dictionary_sorted_index(
+				struct gniggle_dictionary *dict)
+{
+	struct gniggle_trie_iter *iter;
+	const char *word;
+	unsigned int i = 0;
+
+	if (dict->sorted != NULL)
+		return dict->sorted;
+
+	dict->sorted = malloc(sizeof(const char *) * (dict->nwords + 1));
+	iter = gniggle_trie_iterator(gniggle_dictionary_prefix_index(dict));
+	while ((word = gniggle_trie_next(iter)) != NULL) {
+		size_t len;
+		uint32_t hash = gniggle_dictionary_hash(word, &len);
+		dict->sorted[i++] = gniggle_dictionary_slot_word(
+			gniggle_dictionary_probe(dict, word, hash, len));
+	}
+	gniggle_trie_iterator_delete(iter);
+
+	return dict->sorted;
+}
+
+const char *gniggle_dictionary_word(struct gniggle_dictionary *dict,
+				const unsigned int rank, char *buffer)
+{
+	if (rank >= dict->nwords)
+		return NULL;
+
+	if (dict->backend == gniggle_backend_hash)
+		return gniggle_dictionary_sorted_index(dict)[rank];
+
+	if (dict->backend == gniggle_backend_overlay) {
+		gniggle_dictionary_overlay_word(dict, rank, buffer);
+		return buffer;
+	}
+
+	gniggle_trie_word(gniggle_dictionary_prefix_index(dict), rank, buffer);
+
+	return buffer;
+}
+
+uint32_t gniggle_dictionary_id(struct gniggle_dictionary *dict,
+				const char *word)
+{
+	struct gniggle_dictionary_cursor c;
+	const char *p = word;
+	uint32_t hash;
+	size_t len;
+
+	if (word[0] == '\0')
+		return GNIGGLE_NO_WORD;
+
+	/* most guesses that aren't words are turned away here, without
+	 * walking the index
+	 */
+	if (gniggle_dictionary_filter_rejects(dict, word, &hash, &len) == true)
+		return GNIGGLE_NO_WORD;
+
+	gniggle_dictionary_cursor_init(dict, &c);
+	while (*p != '\0')
+		if (gniggle_dictionary_cursor_step(dict, &c, *p++, &c)
+			== false)
+			break;
+
+	if (*p != '\0' || gniggle_dictionary_cursor_word(dict, &c) == false) {
+		if (dict->filterbits != 0 && dict->frozen == false)
+			dict->stats.false_positives++;
+		return GNIGGLE_NO_WORD;
+	}
+
+	return gniggle_dictionary_cursor_rank(&c);
+}
+
+const char **gniggle_dictionary_words(struct gniggle_dictionary *dict,
+				const uint32_t *ids, const unsigned int n)
+{
+	const char **r;
+	char *text, *buffer, *p;
+	size_t size = 1024, length = 0;
+	unsigned int i;
+
+	/* spell every word out one after another, then put them after the
+	 * pointer array so that the whole lot can be freed in one go
+	 */
+	text = malloc(size);
+	buffer = malloc(gniggle_dictionary_maxlen(dict) + 1);
+
+	for (i = 0; i < n; i++) {
+		const char *w = gniggle_dictionary_word(dict, ids[i], buffer);
+		size_t len;
+		if (w == NULL)
+			w = "";
+		len = strlen(w) + 1;
+		while (length + len > size) {
+			size *= 2;
+			text = realloc(text, size);
+		}
+		memcpy(text + length, w, len);
+		length += len;
+	}
+
+	r = malloc((n + 1) * sizeof(char *) + length);
+	p = (char *)(r + n + 1);
+	memcpy(p, text, length);
+
+	for (i = 0; i < n; i++) {
+		r[i] = p;
+		p += strlen(p) + 1;
+	}
+	r[n] = NULL;
+
+	free(text);
+	free(buffer);
+
+	return r;
+}
+
+void gniggle_dictionary_range_init(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_range *range,
+				const unsigned int first, const unsigned int end)
+{
+	range->dict = dict;
+	range->end = (end > dict->nwords) ? dict->nwords : end;
+	range->rank = (first > range->end) ? range->end : first;
+}
+
+void gniggle_dictionary_range_split(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_range *range,
+				const unsigned int part, const unsigned int parts)
+{
+	unsigned long size = dict->nwords;
+	unsigned int n = (parts == 0) ? 1 : parts;
+
+	/* parts past the last are empty */
+	if (part >= n) {
+		gniggle_dictionary_range_init(dict, range, dict->nwords,
+						dict->nwords);
+		return;
+	}
+
+	gniggle_dictionary_range_init(dict, range,
+		(unsigned int)(size * part / n),
+		(unsigned int)(size * (part + 1) / n));
+}
+
+bool gniggle_dictionary_range_prefix(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_range *range,
+				const char *prefix)
+{
+	struct gniggle_dictionary_cursor c;
+
+	gniggle_dictionary_range_init(dict, range, 0, 0);
+
+	gniggle_dictionary_cursor_init(dict, &c);
+	while (*prefix != '\0')
+		if (gniggle_dictionary_cursor_step(dict, &c, *prefix++, &c)
+			== false)
+			return false;
+
+	range->rank = gniggle_dictionary_cursor_rank(&c);
+	range->end = range->rank + gniggle_dictionary_cursor_count(dict, &c);
+
+	return true;
+}
+
+const char *gniggle_dictionary_range_next(
+				struct gniggle_dictionary_range *range,
+				char *buffer)
+{
+	if (range->rank >= range->end)
+		return NULL;
+
+	return gniggle_dictionary_word(range->dict, range->rank++, buffer);
+}
+
+bool gniggle_dictionary_lookup_prefix(struct gniggle_dictionary *dict,
+				const char *prefix)
+{
+	struct gniggle_dictionary_cursor c;
+
+	if (dict->backend != gniggle_backend_overlay)
+		return gniggle_trie_lookup_prefix(
+			gniggle_dictionary_prefix_index(dict), prefix);
+
+	gniggle_dictionary_cursor_init(dict, &c);
+	while (*prefix != '\0')
+		if (gniggle_dictionary_cursor_step(dict, &c, *prefix++, &c)
+			== false)
+			return false;
+
+	return gniggle_dictionary_cursor_count(dict, &c) > 0;
+}
+/* adds one dictionary's figures into another's, for an overlay's layers */
+static void gniggle_dictionary_stats_add(struct gniggle_dictionary_stats *to,
+				const struct gniggle_dictionary_stats *from)
+{
+	to->table_bytes += from->table_bytes;
+	to->string_bytes += from->string_bytes;
+	to->node_bytes += from->node_bytes;
+	to->index_bytes += from->index_bytes;
+	to->filter_bytes += from->filter_bytes;
+	to->total_bytes += from->total_bytes;
+	to->shared_bytes += from->shared_bytes;
+}
+
+void gniggle_dictionary_stats(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_stats *stats)
+{
+	struct gniggle_dictionary_arena *a;
+	unsigned int mask = dict->nslots - 1, i, run = 0;
+	unsigned long probes = 0;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->backend = dict->backend;
+	stats->words = dict->nwords;
+	stats->slots = dict->nslots;
+
+	for (i = 0; i < dict->nslots; i++) {
+		unsigned int probe;
+
+		if (dict->slots[i].hash == 0) {
+			run = 0;
+			continue;
+		}
+
+		probe = ((i - (dict->slots[i].hash & mask)) & mask) + 1;
+		probes += probe;
+		if (probe > stats->longest_probe)
+			stats->longest_probe = probe;
+		if (++run > stats->longest_run)
+			stats->longest_run = run;
+		if (dict->slots[i].word[0] == '\0')
+			stats->long_words++;
+		stats->used_slots++;
+	}
+
+	/* a run can wrap around from the end of the table to the start */
+	if (run != 0 && run != dict->nslots) {
+		for (i = 0; dict->slots[i].hash != 0; i++)
+			run++;
+		if (run > stats->longest_run)
+			stats->longest_run = run;
+	}
+
+	if (dict->nslots != 0)
+		stats->load = stats->used_slots * 100 / dict->nslots;
+	if (stats->used_slots != 0)
+		stats->mean_probe = probes * 100 / stats->used_slots;
+
+	stats->table_bytes = (sizeof(struct gniggle_dictionary_slot) +
+				sizeof(uint32_t)) * dict->nslots;
+	for (a = dict->arena; a != NULL; a = a->next)
+		stats->string_bytes += sizeof(*a) + a->size;
+	if (dict->trie != NULL) {
+		stats->nodes = gniggle_trie_nodes(dict->trie);
+		stats->node_bytes = gniggle_trie_memory(dict->trie,
+							&stats->shared_bytes);
+	}
+	if (dict->map != NULL)
+		stats->shared_bytes = dict->maplen;
+	if (dict->sorted != NULL)
+		stats->index_bytes = sizeof(const char *) * (dict->nwords + 1);
+	if (dict->filter != NULL)
+		stats->filter_bytes = sizeof(uint64_t) * GNIGGLE_FILTER_BLOCK *
+					(dict->filtermask + 1);
+
+	stats->total_bytes = sizeof(struct gniggle_dictionary) +
+		stats->table_bytes + stats->string_bytes + stats->node_bytes +
+		stats->index_bytes + stats->filter_bytes;
+
+	if (dict->backend == gniggle_backend_overlay) {
+		struct gniggle_dictionary_stats layer;
+
+		gniggle_dictionary_stats(dict->added, &layer);
+		gniggle_dictionary_stats_add(stats, &layer);
+		gniggle_dictionary_stats(dict->removed, &layer);
+		gniggle_dictionary_stats_add(stats, &layer);
+	}
+}
+
+unsigned int gniggle_dictionary_size(struct gniggle_dictionary *dict)
+{
+	return dict->nwords;
+}
+	
+struct gniggle_dictionary_iter *gniggle_dictionary_iterator(
+				struct gniggle_dictionary *dict)
+{
+	struct gniggle_dictionary_iter *r = calloc(
+				sizeof(struct gniggle_dictionary_iter), 1);
+	
+	r->dict = dict;
+	r->slot = 0;
+
+	if (dict->backend == gniggle_backend_trie)
+		r->trie = gniggle_trie_iterator(dict->trie);
+	else if (dict->backend == gniggle_backend_overlay)
+		r->inner = gniggle_dictionary_iterator(dict->base);
+	
+	return r;
+}
+			
+const char *gniggle_dictionary_next(struct gniggle_dictionary_iter *iter)
+{
+	if (iter->trie != NULL)
+		return gniggle_trie_next(iter->trie);
+
+	/* an overlay gives its base's words, less those removed, and then
+	 * the words it adds
+	 */
+	while (iter->inner != NULL) {
+		const char *r = gniggle_dictionary_next(iter->inner);
+		if (r == NULL) {
+			gniggle_dictionary_iterator_delete(iter->inner);
+			iter->inner = NULL;
+			if (iter->second == false) {
+				iter->inner = gniggle_dictionary_iterator(
+						iter->dict->added);
+				iter->second = true;
+			}
+		} else if (iter->second == true ||
+			gniggle_dictionary_lookup(iter->dict->removed, r)
+				== false) {
+			return r;
+		}
+	}
+
+	if (iter->sorted == true) {
+		if (iter->rank == iter->end)
+			return NULL;
+		return gniggle_dictionary_word(iter->dict, iter->rank++,
+						iter->word);
+	}
+
+	while (iter->slot < iter->dict->nslots) {
+		const struct gniggle_dictionary_slot *s =
+			&iter->dict->slots[iter->slot++];
+		if (s->hash != 0)
+			return gniggle_dictionary_slot_word(s);
+	}
+	
+	return NULL;
+}
+
+const char *gniggle_dictionary_next_signature(
+				struct gniggle_dictionary_iter *iter,
+				unsigned int *signature)
+{
+	const char *r = gniggle_dictionary_next(iter);
+
+	if (r == NULL)
+		return NULL;
+
+	/* trie dictionaries have nowhere to keep signatures, but working
+	 * one out is cheap next to walking the trie
+	 */
+	if (iter->trie != NULL || iter->sorted == true ||
+		iter->dict->backend == gniggle_backend_overlay)
+		*signature = gniggle_dictionary_signature(r);
+	else
+		*signature = iter->dict->sigs[iter->slot - 1];
+
+	return r;
+}
+
+struct gniggle_dictionary_iter *gniggle_dictionary_iterator_prefix(
+				struct gniggle_dictionary *dict,
+				const char *prefix)
+{
+	struct gniggle_dictionary_iter *r = calloc(
+				sizeof(struct gniggle_dictionary_iter), 1);
+	struct gniggle_dictionary_cursor c;
+
+	r->dict = dict;
+	r->sorted = true;
+	r->word = calloc(gniggle_dictionary_maxlen(dict) + 1, 1);
+
+	/* the words starting with the prefix have neighbouring ranks, the
+	 * first being the rank the prefix itself would have
+	 */
+	gniggle_dictionary_cursor_init(dict, &c);
+	while (*prefix != '\0')
+		if (gniggle_dictionary_cursor_step(dict, &c, *prefix++, &c)
+			== false)
+			return r;
+
+	r->rank = gniggle_dictionary_cursor_rank(&c);
+	r->end = r->rank + gniggle_dictionary_cursor_count(dict, &c);
+
+	return r;
+}
+
+void gniggle_dictionary_iterator_delete(struct gniggle_dictionary_iter *iter)
+{
+	if (iter->trie != NULL)
+		gniggle_trie_iterator_delete(iter->trie);
+	if (iter->inner != NULL)
+		gniggle_dictionary_iterator_delete(iter->inner);
+	free(iter->word);
+	free(iter);
+}
+
+static void gniggle_dictionary_put32(unsigned char *p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t gniggle_dictionary_get32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int gniggle_dictionary_dump(struct gniggle_dictionary *dict,
+    					const char *filename)
+{
+	return gniggle_dictionary_dump_sections(dict, filename,
+						GNIGGLE_DUMP_ALL);
+}
+
+int gniggle_dictionary_dump_sections(struct gniggle_dictionary *dict,
+					const char *filename,
+					const unsigned int sections)
+{
+	gzFile fh;
+	struct gniggle_dictionary_iter *iter;
+	unsigned char head[GNIGGLE_DUMP_HEADER], tail[4];
+	unsigned char *sigs = NULL, *lengths = NULL;
+	char *text;
+	const char *word;
+	size_t textlen = 0, textsize = 65536;
+	unsigned int nwords = 0, maxlen = 0, i;
+	uLong crc;
+	bool ok;
+
+	/* gather everything first, as the header needs the totals */
+	if ((sections & GNIGGLE_DUMP_SORTED) != 0)
+		iter = gniggle_dictionary_iterator_prefix(dict, "");
+	else
+		iter = gniggle_dictionary_iterator(dict);
+
+	text = malloc(textsize);
+	if ((sections & GNIGGLE_DUMP_SIGNATURES) != 0)
+		sigs = malloc(sizeof(uint32_t) * (dict->nwords + 1));
+
+	while ((word = gniggle_dictionary_next(iter)) != NULL) {
+		size_t len = strlen(word);
+		while (textlen + len + 1 > textsize) {
+			textsize *= 2;
+			text = realloc(text, textsize);
+		}
+		memcpy(text + textlen, word, len + 1);
+		textlen += len + 1;
+		if (sigs != NULL)
+			gniggle_dictionary_put32(sigs + nwords * 4,
+				gniggle_dictionary_signature(word));
+		if (len > maxlen)
+			maxlen = len;
+		nwords++;
+	}
+	gniggle_dictionary_iterator_delete(iter);
+
+	if ((sections & GNIGGLE_DUMP_LENGTHS) != 0) {
+		lengths = calloc(sizeof(uint32_t), maxlen + 1);
+		for (i = 0, word = text; i < nwords; i++) {
+			size_t len = strlen(word);
+			gniggle_dictionary_put32(lengths + len * 4,
+				gniggle_dictionary_get32(lengths + len * 4) + 1);
+			word += len + 1;
+		}
+	}
+
+	memcpy(head, "GNIGDICT", 8);
+	gniggle_dictionary_put32(head + 8, GNIGGLE_DUMP_VERSION);
+	gniggle_dictionary_put32(head + 12, sections & GNIGGLE_DUMP_ALL);
+	gniggle_dictionary_put32(head + 16, dict->gx);
+	gniggle_dictionary_put32(head + 20, dict->gy);
+	gniggle_dictionary_put32(head + 24, nwords);
+	gniggle_dictionary_put32(head + 28, textlen);
+	gniggle_dictionary_put32(head + 32, maxlen);
+
+	crc = crc32(0L, head, GNIGGLE_DUMP_HEADER);
+	crc = crc32(crc, (const Bytef *)text, textlen);
+	if (sigs != NULL)
+		crc = crc32(crc, sigs, nwords * 4);
+	if (lengths != NULL)
+		crc = crc32(crc, lengths, (maxlen + 1) * 4);
+	gniggle_dictionary_put32(tail, crc);
+
+	fh = gzopen(filename, "wb");
+	ok = fh != NULL;
+	if (ok == true) {
+		gzsetparams(fh, Z_BEST_COMPRESSION, Z_DEFAULT_STRATEGY);
+		ok = gzwrite(fh, head, GNIGGLE_DUMP_HEADER) > 0 &&
+			(textlen == 0 || gzwrite(fh, text, textlen) > 0) &&
+			(sigs == NULL || nwords == 0 ||
+				gzwrite(fh, sigs, nwords * 4) > 0) &&
+			(lengths == NULL ||
+				gzwrite(fh, lengths, (maxlen + 1) * 4) > 0) &&
+			gzwrite(fh, tail, 4) > 0;
+		if (gzclose(fh) != Z_OK)
+			ok = false;
+	}
+
+	free(text);
+	free(sigs);
+	free(lengths);
+
+	return (ok == true) ? 0 : -1;
+}
+
+/* reads a section of a dump 'size' bytes long, growing the buffer a chunk
+ * at a time as the bytes arrive, so that a header claiming more than the
+ * file holds costs no more memory than the file does.  Returns NULL if the
+ * section is short.
+ */
+static unsigned char *gniggle_dictionary_read_section(gzFile fh, size_t size)
+{
+	unsigned char *r = NULL, *grown;
+	size_t got = 0, want;
+
+	do {
+		want = (size - got < GNIGGLE_DUMP_CHUNK) ? size - got :
+							GNIGGLE_DUMP_CHUNK;
+		grown = realloc(r, got + want + 1);
+		if (grown == NULL ||
+			(want > 0 && gzread(fh, grown + got, want) !=
+				(int)want)) {
+			free(grown != NULL ? grown : r);
+			return NULL;
+		}
+		r = grown;
+		got += want;
+	} while (got < size);
+
+	return r;
+}
+
+/* reads the rest of a version 2 dump, the first twelve bytes of which are
+ * already in 'head'.  Every section is read and checked against the
+ * checksum before any of it is used.
+ */
+static struct gniggle_dictionary *gniggle_dictionary_undump_v2(gzFile fh,
+					unsigned char *head,
+					const unsigned int x,
+					const unsigned int y,
+					gniggle_dictionary_backend backend)
 {
-	free(iter);
-}
+#	define READ(p, s) (gzread(fh, (p), (s)) == (int)(s))
+	struct gniggle_dictionary *d = NULL;
+	unsigned char *sigs = NULL, *lengths = NULL, tail[4];
+	const char **order = NULL;
+	char *text = NULL;
+	const char *p;
+	const char *last = NULL;
+	unsigned int sections, gx, gy, nwords, textlen, maxlen, i, n = 0;
+	bool refilter;
+	uLong crc;
 
-int gniggle_dictionary_dump(struct gniggle_dictionary *dict,
-    					const char *filename)
-{
-  	gzFile fh = gzopen(filename, "wb");
-#	define WRITE(d, s) gzwrite(fh, (d), (s))
-	size_t l;
-	uint32_t magic = 0x12345678;
-	unsigned char fl;
+	if (READ(head + 12, GNIGGLE_DUMP_HEADER - 12) == false)
+		return NULL;
 
-	if (fh == NULL)
-		return -1;
+	sections = gniggle_dictionary_get32(head + 12);
+	gx = gniggle_dictionary_get32(head + 16);
+	gy = gniggle_dictionary_get32(head + 20);
+	nwords = gniggle_dictionary_get32(head + 24);
+	textlen = gniggle_dictionary_get32(head + 28);
+	maxlen = gniggle_dictionary_get32(head + 32);
 
-	gzsetparams(fh, Z_BEST_COMPRESSION, Z_DEFAULT_STRATEGY);
+	/* each word takes at least two bytes, there is text only if there
+	 * are words, and no word is longer than all of them together or
+	 * too long for the grid the dump was made for
+	 */
+	if (textlen > GNIGGLE_DUMP_MAX_TEXT || textlen / 2 < nwords ||
+		(nwords == 0 && textlen > 0) || maxlen > textlen ||
+		maxlen > (unsigned long)gx * gy)
+		return NULL;
 
-	WRITE("GNIGDICT", 8); /* identifier */
-	WRITE(&magic, sizeof(magic)); /* endian detection word */
+	/* words only need checking against the grid if it's smaller than
+	 * the one they were chosen for
+	 */
+	refilter = (unsigned long)x * y < (unsigned long)gx * gy;
 
-	fl = sizeof(unsigned char);
-	WRITE(&fl, sizeof(fl)); /* size of unsigned char */
-	
-	fl = sizeof(unsigned short);
-	WRITE(&fl, sizeof(fl)); /* size of short */
+	text = (char *)gniggle_dictionary_read_section(fh, textlen);
+	if (text == NULL)
+		goto out;
+	if ((sections & GNIGGLE_DUMP_SIGNATURES) != 0) {
+		sigs = gniggle_dictionary_read_section(fh, nwords * 4);
+		if (sigs == NULL)
+			goto out;
+	}
+	if ((sections & GNIGGLE_DUMP_LENGTHS) != 0) {
+		lengths = gniggle_dictionary_read_section(fh,
+							(maxlen + 1) * 4);
+		if (lengths == NULL)
+			goto out;
+	}
+	if (READ(tail, 4) == false)
+		goto out;
 
-	WRITE(&dict->nwords, sizeof(dict->nwords));
-	WRITE(&dict->hashsize, sizeof(dict->hashsize));
-	
-	for (l = 0; l < dict->hashsize; l++) {
-		unsigned short chainsize = 0; 
-		struct gniggle_dictionary_hash_e *e = dict->hash[l];
+	crc = crc32(0L, head, GNIGGLE_DUMP_HEADER);
+	crc = crc32(crc, (const Bytef *)text, textlen);
+	if (sigs != NULL)
+		crc = crc32(crc, sigs, nwords * 4);
+	if (lengths != NULL)
+		crc = crc32(crc, lengths, (maxlen + 1) * 4);
+
+	if ((crc & 0xffffffff) != gniggle_dictionary_get32(tail) ||
+		(textlen > 0 && text[textlen - 1] != '\0'))
+		goto out;
+
+	/* the table is sized by the word count, so make sure the text really
+	 * holds that many words before trusting it
+	 */
+	for (i = 0; i < textlen; i++)
+		if (text[i] == '\0')
+			n++;
+	if (n != nwords)
+		goto out;
+	n = 0;
 
-		while (e != NULL) {
-			chainsize++;
-			e = e->next;
+	if (backend == gniggle_backend_trie) {
+		d = gniggle_dictionary_new_trie(x, y);
+	} else {
+		d = gniggle_dictionary_new(x, y, nwords);
+
+		/* the lengths say exactly how much of the arena long words
+		 * will need
+		 */
+		if (lengths != NULL) {
+			size_t longest = 0;
+			for (i = GNIGGLE_SLOT_INLINE; i <= maxlen; i++)
+				if (refilter == false || i <= x * y)
+					longest += (size_t)(i + 1) *
+						gniggle_dictionary_get32(
+							lengths + i * 4);
+			gniggle_dictionary_arena_reserve(d, longest);
 		}
 
-		WRITE(&chainsize, sizeof(chainsize));
+		/* the table was sized for every word up front, so the words
+		 * stay put and the sorted index can be filled in as they go
+		 */
+		if ((sections & GNIGGLE_DUMP_SORTED) != 0)
+			order = malloc(sizeof(const char *) * (nwords + 1));
+	}
 
-		if (chainsize != 0) {
-			unsigned char sl;
-		  	e = dict->hash[l];
-			while (e != NULL) {
-				sl = strlen(e->word);
-				WRITE(&sl, sizeof(sl));
-				WRITE(e->word, sl);
-				e = e->next;
-			}
+	for (i = 0, p = text; i < nwords && p < text + textlen; i++) {
+		size_t len = strlen(p);
 
+		/* the dump may have been made for a bigger grid */
+		if (refilter == false || len <= x * y) {
+			const char *w = gniggle_dictionary_insert_signed(d, p,
+				(sigs != NULL) ?
+				gniggle_dictionary_get32(sigs + i * 4) :
+				gniggle_dictionary_signature(p));
+
+			/* the text is only taken as being in order if it
+			 * really is
+			 */
+			if (order != NULL && last != NULL &&
+				strcmp(last, p) >= 0) {
+				free(order);
+				order = NULL;
+			}
+			if (order != NULL)
+				order[n++] = w;
+			last = p;
 		}
-		
+
+		p += len + 1;
 	}
-	gzclose(fh);
-#undef WRITE
 
-	return 0;
+	if (order != NULL && n == d->nwords) {
+		d->sorted = order;
+		order = NULL;
+	}
+
+	if (backend == gniggle_backend_trie)
+		gniggle_trie_minimise(d->trie);
+
+out:
+	free(text);
+	free(sigs);
+	free(lengths);
+	free(order);
+#undef READ
+	return d;
 }
 
-struct gniggle_dictionary *gniggle_dictionary_undump(const unsigned x,
-    					const unsigned y, const char *filename)
+static struct gniggle_dictionary *gniggle_dictionary_undump_backend(
+					const unsigned int x,
+					const unsigned int y,
+					const char *filename,
+					gniggle_dictionary_backend backend)
 {
 	gzFile fh = gzopen(filename, "rb");
 #	define READ(p, s) gzread(fh, (p), (s))
@@ -328,6 +1847,7 @@ struct gniggle_dictionary *gniggle_dictionary_undump(const unsigned x,
 	unsigned char fl;
 	char head[8];
 	size_t l;
+	unsigned int nwords, hashsize;
 
 	struct gniggle_dictionary *d;
 
@@ -342,8 +1862,19 @@ struct gniggle_dictionary *gniggle_dictionary_undump(const unsigned x,
 
 	READ(&magic, sizeof(uint32_t));
 	if (magic != 0x12345678) {
+		unsigned char v2[GNIGGLE_DUMP_HEADER];
+
+		/* not the original format, in which this is an endianness
+		 * check.  Later versions store their version number here.
+		 */
+		memcpy(v2, head, 8);
+		memcpy(v2 + 8, &magic, sizeof(magic));
+		d = NULL;
+		if (gniggle_dictionary_get32(v2 + 8) == GNIGGLE_DUMP_VERSION)
+			d = gniggle_dictionary_undump_v2(fh, v2, x, y,
+							backend);
 		gzclose(fh);
-		return NULL;
+		return d;
 	}
 
 	READ(&fl, sizeof(fl));
@@ -358,62 +1889,261 @@ struct gniggle_dictionary *gniggle_dictionary_undump(const unsigned x,
 		return NULL;
 	}
 
-	d = calloc(sizeof(struct gniggle_dictionary), 1);
-
-	READ(&d->nwords, sizeof(d->nwords));
-	READ(&d->hashsize, sizeof(d->hashsize));
-
-	d->gx = x;
-	d->gy = y;
-
+	READ(&nwords, sizeof(nwords));
+	READ(&hashsize, sizeof(hashsize));
 
-	d->hash = calloc(sizeof(struct gniggle_dictionary_hash_e **),
-	    			d->hashsize);
+	if (backend == gniggle_backend_trie)
+		d = gniggle_dictionary_new_trie(x, y);
+	else
+		d = gniggle_dictionary_new(x, y, nwords);
 
-	for (l = 0; l < d->hashsize; l++) {
+	for (l = 0; l < hashsize; l++) {
 		unsigned short chainsize;
 		int w;
 		READ(&chainsize, sizeof(chainsize));
 		for (w = 0; w < chainsize; w++) {
-			struct gniggle_dictionary_hash_e *e;
+			char word[256];
 			unsigned char wl;
-			e = calloc(sizeof(
-				struct gniggle_dictionary_hash_e), 1);
 			READ(&wl, sizeof(wl));
-			e->word = calloc(wl + 1, 1);
-			READ(e->word, wl);
-			e->next = d->hash[l];
-			d->hash[l] = e;
+			READ(word, wl);
+			word[wl] = '\0';
+			gniggle_dictionary_insert(d, word);
 		}
 	}
+
+	if (backend == gniggle_backend_trie)
+		gniggle_trie_minimise(d->trie);
+
 	gzclose(fh);
 #undef READ
 	return d;
 }
 
-struct gniggle_dictionary *gniggle_dictionary_new_from_file(
+struct gniggle_dictionary *gniggle_dictionary_undump(const unsigned x,
+    					const unsigned y, const char *filename)
+{
+	return gniggle_dictionary_undump_backend(x, y, filename,
+						gniggle_backend_hash);
+}
+
+int gniggle_dictionary_dump_mapped(struct gniggle_dictionary *dict,
+					const char *filename)
+{
+	struct gniggle_trie *trie;
+	unsigned char head[GNIGGLE_MAP_HEADER];
+	size_t nodes;
+	FILE *fh;
+
+	if (dict->backend == gniggle_backend_overlay) {
+		struct gniggle_dictionary *flat =
+				gniggle_dictionary_flatten(dict);
+		int r = gniggle_dictionary_dump_mapped(flat, filename);
+		gniggle_dictionary_delete(flat);
+		return r;
+	}
+
+	trie = gniggle_dictionary_prefix_index(dict);
+
+	gniggle_trie_minimise(trie);
+	nodes = gniggle_trie_nodes(trie);
+
+	memset(head, 0, sizeof(head));
+	memcpy(head, GNIGGLE_MAP_MAGIC, 8);
+	gniggle_dictionary_put32(head + 8, GNIGGLE_MAP_VERSION);
+	gniggle_dictionary_put32(head + 12, nodes);
+	gniggle_dictionary_put32(head + 16, dict->nwords);
+	gniggle_dictionary_put32(head + 20, gniggle_trie_maxlen(trie));
+	gniggle_dictionary_put32(head + 24, dict->gx);
+	gniggle_dictionary_put32(head + 28, dict->gy);
+
+	fh = fopen(filename, "wb");
+	if (fh == NULL)
+		return -1;
+
+	if (fwrite(head, sizeof(head), 1, fh) != 1 ||
+		fwrite(gniggle_trie_data(trie), sizeof(uint32_t) * 2, nodes,
+			fh) != nodes) {
+		fclose(fh);
+		return -1;
+	}
+
+	return (fclose(fh) == 0) ? 0 : -1;
+}
+
+struct gniggle_dictionary *gniggle_dictionary_new_static(
 					const unsigned int x,
 					const unsigned int y,
-					const unsigned int hashsize,
+					const void *nodes,
+					const unsigned int nnodes,
+					const uint32_t *counts,
+					const unsigned int nwords,
+					const unsigned int maxlen)
+{
+	struct gniggle_dictionary *d = calloc(
+				sizeof(struct gniggle_dictionary), 1);
+
+	d->gx = x;
+	d->gy = y;
+	d->backend = gniggle_backend_trie;
+	d->load = GNIGGLE_DEFAULT_LOAD;
+	d->nwords = nwords;
+	d->trie = gniggle_trie_new_static(nodes, nnodes, maxlen, counts);
+
+	return d;
+}
+
+int gniggle_dictionary_dump_source(struct gniggle_dictionary *dict,
 					const char *filename)
 {
-	FILE *fh = fopen(filename, "rb");
-	unsigned char head[2];
+	FILE *fh;
+	struct gniggle_trie *trie;
+	const uint32_t *nodes, *counts;
+	unsigned int nnodes, i;
+	int r;
+
+	if (dict != NULL && dict->backend == gniggle_backend_overlay) {
+		struct gniggle_dictionary *flat =
+				gniggle_dictionary_flatten(dict);
+		r = gniggle_dictionary_dump_source(flat, filename);
+		gniggle_dictionary_delete(flat);
+		return r;
+	}
 
+	fh = fopen(filename, "w");
 	if (fh == NULL)
+		return -1;
+
+	fprintf(fh, "/* generated by gniggle_dictionary_dump_source(); "
+			"do not edit */\n\n"
+			"#include <stddef.h>\n"
+			"#include <stdint.h>\n"
+			"#include \"dictionary.h\"\n\n");
+
+	if (dict == NULL) {
+		fprintf(fh, "struct gniggle_dictionary "
+				"*gniggle_dictionary_embedded(\n"
+				"\t\t\t\tconst unsigned int x,\n"
+				"\t\t\t\tconst unsigned int y)\n"
+				"{\n\t(void)x;\n\t(void)y;\n\n"
+				"\treturn NULL;\n}\n");
+		return (fclose(fh) == 0) ? 0 : -1;
+	}
+
+	trie = gniggle_dictionary_prefix_index(dict);
+	gniggle_trie_minimise(trie);
+	counts = gniggle_trie_counts(trie);
+	nodes = gniggle_trie_data(trie);
+	nnodes = gniggle_trie_nodes(trie);
+
+	/* the values are written as they lie in memory, so the generated
+	 * source is for machines of the same byte order as this one
+	 */
+	fprintf(fh, "static const uint32_t nodes[] = {");
+	for (i = 0; i < nnodes * 2; i++)
+		fprintf(fh, "%s0x%08lx,", (i % 6 == 0) ? "\n\t" : " ",
+			(unsigned long)nodes[i]);
+
+	fprintf(fh, "\n};\n\nstatic const uint32_t counts[] = {");
+	for (i = 0; i < nnodes; i++)
+		fprintf(fh, "%s%lu,", (i % 8 == 0) ? "\n\t" : " ",
+			(unsigned long)counts[i]);
+
+	fprintf(fh, "\n};\n\n"
+			"struct gniggle_dictionary "
+			"*gniggle_dictionary_embedded(\n"
+			"\t\t\t\tconst unsigned int x,\n"
+			"\t\t\t\tconst unsigned int y)\n"
+			"{\n\treturn gniggle_dictionary_new_static(x, y, "
+			"nodes, %u, counts,\n\t\t\t\t%u, %u);\n}\n",
+			nnodes, dict->nwords, gniggle_trie_maxlen(trie));
+
+	r = ferror(fh) ? -1 : 0;
+	if (fclose(fh) != 0)
+		r = -1;
+
+	return r;
+}
+
+struct gniggle_dictionary *gniggle_dictionary_map(const unsigned int x,
+					const unsigned int y,
+					const char *filename)
+{
+	struct gniggle_dictionary *d;
+	struct stat st;
+	unsigned char *map;
+	uint32_t nnodes;
+	int fd = open(filename, O_RDONLY);
+
+	if (fd == -1)
 		return NULL;
 
-	if (fread(head, 2, 1, fh) < 1) {
-		fclose(fh);
+	if (fstat(fd, &st) == -1 || st.st_size < GNIGGLE_MAP_HEADER) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return NULL;
+
+	/* only the header is checked up front, so that opening an image
+	 * takes the same time however big it is.  The trie checks each link
+	 * in the nodes as it follows it, and never goes deeper than the
+	 * longest word, which can't need more nodes than there are.
+	 */
+	nnodes = gniggle_dictionary_get32(map + 12);
+	if (memcmp(map, GNIGGLE_MAP_MAGIC, 8) != 0 ||
+		gniggle_dictionary_get32(map + 8) != GNIGGLE_MAP_VERSION ||
+		nnodes == 0 || gniggle_dictionary_get32(map + 20) >= nnodes ||
+		(size_t)st.st_size != GNIGGLE_MAP_HEADER +
+			(size_t)nnodes * sizeof(uint32_t) * 2) {
+		munmap(map, st.st_size);
 		return NULL;
 	}
+
+	d = gniggle_dictionary_new_static(x, y, map + GNIGGLE_MAP_HEADER,
+					nnodes, NULL,
+					gniggle_dictionary_get32(map + 16),
+					gniggle_dictionary_get32(map + 20));
+	d->map = map;
+	d->maplen = st.st_size;
+
+	return d;
+}
+
+static struct gniggle_dictionary *gniggle_dictionary_new_from_file_backend(
+					const unsigned int x,
+					const unsigned int y,
+					const unsigned int hashsize,
+					const char *filename,
+					gniggle_dictionary_backend backend)
+{
+	FILE *fh = fopen(filename, "rb");
+	unsigned char head[8];
+	size_t got;
+
+	if (fh == NULL)
+		return NULL;
+
+	got = fread(head, 1, 8, fh);
 	fclose(fh);
 
-	if (head[0] == 0x1f && head[1] == 0x8b) {	/* gzip header? */
-		return gniggle_dictionary_undump(x, y, filename);
+	if (got < 2)
+		return NULL;
+
+	if (got == 8 && memcmp(head, GNIGGLE_MAP_MAGIC, 8) == 0) {
+		return gniggle_dictionary_map(x, y, filename);
+	} else if (head[0] == 0x1f && head[1] == 0x8b) { /* gzip header? */
+		return gniggle_dictionary_undump_backend(x, y, filename,
+							backend);
 	} else {
 		struct gniggle_dictionary *d;
-		d = gniggle_dictionary_new(x, y, hashsize);
+		if (backend == gniggle_backend_trie)
+			d = gniggle_dictionary_new_trie(x, y);
+		else
+			d = gniggle_dictionary_new(x, y, hashsize);
 		gniggle_dictionary_load_file(d, filename);
 		return d;
 	}
@@ -421,29 +2151,352 @@ struct gniggle_dictionary *gniggle_dictionary_new_from_file(
 	return NULL;
 }
 
+struct gniggle_dictionary *gniggle_dictionary_new_from_file(
+					const unsigned int x,
+					const unsigned int y,
+					const unsigned int hashsize,
+					const char *filename)
+{
+	return gniggle_dictionary_new_from_file_backend(x, y, hashsize,
+					filename, gniggle_backend_hash);
+}
 
-int gniggle_dictionary_load_file(struct gniggle_dictionary *dict,
+struct gniggle_dictionary *gniggle_dictionary_new_trie_from_file(
+					const unsigned int x,
+					const unsigned int y,
 					const char *filename)
 {
-	FILE *fh = fopen(filename, "r");
+	return gniggle_dictionary_new_from_file_backend(x, y, 0,
+					filename, gniggle_backend_trie);
+}
+
+
+/* the loader splits word lists into chunks of at least this size, one per
+ * thread, up to GNIGGLE_LOAD_THREADS of them
+ */
+#define GNIGGLE_LOAD_CHUNK (256 * 1024)
+#define GNIGGLE_LOAD_THREADS 16
+
+/* a chunk of a word list being loaded by one thread */
+struct gniggle_dictionary_chunk {
+	const char *start, *end;	/* text to read */
+	unsigned int maxlen;		/* longest word allowed */
+	char *words;			/* qualifying words, each NUL ended */
+	size_t length;			/* bytes used in words */
+	unsigned int nwords;		/* number of words in words */
+	int count;			/* words scanned */
+	pthread_t thread;
+	bool threaded;			/* thread needs joining */
+};
+
+static bool gniggle_dictionary_space(const char c)
+{
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' ||
+		c == '\v' || c == '\f';
+}
+
+static void *gniggle_dictionary_load_chunk(void *p)
+{
+	struct gniggle_dictionary_chunk *c = p;
+	const char *s = c->start;
+
+	/* a word can be no longer than the text it came from */
+	c->words = malloc(c->end - c->start + 1);
+	c->length = 0;
+	c->nwords = 0;
+	c->count = 0;
+
+	while (s < c->end) {
+		const char *w;
+		int l;
+
+		while (s < c->end && gniggle_dictionary_space(*s))
+			s++;
+		if (s == c->end)
+			break;
+
+		w = s;
+		while (s < c->end && !gniggle_dictionary_space(*s))
+			s++;
+
+		c->count++;
+		l = gniggle_dictionary_normalise_into(w, s - w,
+					c->words + c->length, c->maxlen);
+		if (l != -1) {
+			c->length += l + 1;
+			c->nwords++;
+		}
+	}
+
+	return NULL;
+}
+
+/* the original loader, for files that cannot be mapped */
+static int gniggle_dictionary_load_stream(struct gniggle_dictionary *dict,
+					FILE *fh)
+{
 	char word[BUFSIZ];
 	int count = 0;
 	
-	if (fh == NULL)
-		return -1;
-	
 	while (!feof(fh)) {
 		if (fscanf(fh, "%s", word) < 1)
 			break;
 		gniggle_dictionary_add(dict, word);
 		count++;
 	}
+
+	return count;
+}
+
+int gniggle_dictionary_load_file(struct gniggle_dictionary *dict,
+					const char *filename)
+{
+	struct gniggle_dictionary_chunk chunk[GNIGGLE_LOAD_THREADS];
+	const char *text, *p;
+	struct stat st;
+	int fd = open(filename, O_RDONLY);
+	int count = 0, n, i;
+	long cpus;
+	unsigned int total = 0;
 	
-	fclose(fh);
+	if (dict->frozen == true) {
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+
+	if (fd == -1)
+		return -1;
+
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+		(text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+			== MAP_FAILED) {
+		FILE *fh = fdopen(fd, "r");
+		if (fh == NULL) {
+			close(fd);
+			return -1;
+		}
+		count = gniggle_dictionary_load_stream(dict, fh);
+		fclose(fh);
+		if (dict->backend == gniggle_backend_trie)
+			gniggle_trie_minimise(dict->trie);
+		return count;
+	}
+
+	close(fd);
+
+	/* split the text into chunks, moving each split forward to the
+	 * next space so no word is cut in two
+	 */
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	n = st.st_size / GNIGGLE_LOAD_CHUNK + 1;
+	if (n > cpus)
+		n = (cpus < 1) ? 1 : cpus;
+	if (n > GNIGGLE_LOAD_THREADS)
+		n = GNIGGLE_LOAD_THREADS;
+
+	for (i = 0, p = text; i < n; i++) {
+		const char *end = text + (st.st_size / n) * (i + 1);
+		if (i == n - 1 || end < p)
+			end = text + st.st_size;
+		while (end < text + st.st_size &&
+			!gniggle_dictionary_space(*end))
+			end++;
+		chunk[i].start = p;
+		chunk[i].end = end;
+		chunk[i].maxlen = dict->gx * dict->gy;
+		p = end;
+	}
+
+	for (i = 1; i < n; i++) {
+		chunk[i].threaded = pthread_create(&chunk[i].thread, NULL,
+				gniggle_dictionary_load_chunk, &chunk[i]) == 0;
+		if (chunk[i].threaded == false)
+			gniggle_dictionary_load_chunk(&chunk[i]);
+	}
+	gniggle_dictionary_load_chunk(&chunk[0]);
+	for (i = 1; i < n; i++)
+		if (chunk[i].threaded == true)
+			pthread_join(chunk[i].thread, NULL);
+
+	munmap((void *)text, st.st_size);
+
+	/* merge the chunks in order, so the result is just as if the words
+	 * had been added one at a time
+	 */
+	for (i = 0; i < n; i++)
+		total += chunk[i].nwords;
+	if (dict->backend == gniggle_backend_hash)
+		gniggle_dictionary_reserve(dict, dict->nwords + total);
+
+	for (i = 0; i < n; i++) {
+		size_t o = 0;
+		while (o < chunk[i].length) {
+			gniggle_dictionary_insert(dict, chunk[i].words + o);
+			o += strlen(chunk[i].words + o) + 1;
+		}
+		free(chunk[i].words);
+		count += chunk[i].count;
+	}
+
+	if (dict->backend == gniggle_backend_trie)
+		gniggle_trie_minimise(dict->trie);
 	
 	return count;
 }
 
+/* builds everything a dictionary would otherwise build the first time it is
+ * needed, so that once it is shared, looking words up never changes it
+ */
+static void gniggle_dictionary_settle(struct gniggle_dictionary *dict)
+{
+	if (dict->backend == gniggle_backend_overlay) {
+		gniggle_dictionary_settle(dict->base);
+		gniggle_dictionary_settle(dict->added);
+		gniggle_dictionary_settle(dict->removed);
+	} else {
+		gniggle_dictionary_prefix_index(dict);
+		if (dict->backend == gniggle_backend_hash)
+			gniggle_dictionary_sorted_index(dict);
+	}
+
+	if (dict->filterbits != 0 && dict->filter == NULL)
+		gniggle_dictionary_filter_build(dict);
+}
+
+struct gniggle_dictionary *gniggle_dictionary_new_overlay(
+				struct gniggle_dictionary *base)
+{
+	struct gniggle_dictionary *r = calloc(sizeof(struct gniggle_dictionary),
+						1);
+	r->gx = base->gx;
+	r->gy = base->gy;
+	r->backend = gniggle_backend_overlay;
+	r->load = GNIGGLE_DEFAULT_LOAD;
+	r->nwords = base->nwords;
+	r->added = gniggle_dictionary_new(base->gx, base->gy, 0);
+	r->removed = gniggle_dictionary_new(base->gx, base->gy, 0);
+
+	if (base->backend == gniggle_backend_overlay) {
+		/* rather than stacking, share the same base and start with
+		 * copies of the changes, which are small
+		 */
+		struct gniggle_dictionary_iter *iter;
+		const char *word;
+
+		iter = gniggle_dictionary_iterator(base->added);
+		while ((word = gniggle_dictionary_next(iter)) != NULL)
+			gniggle_dictionary_insert(r->added, word);
+		gniggle_dictionary_iterator_delete(iter);
+
+		iter = gniggle_dictionary_iterator(base->removed);
+		while ((word = gniggle_dictionary_next(iter)) != NULL)
+			gniggle_dictionary_insert(r->removed, word);
+		gniggle_dictionary_iterator_delete(iter);
+
+		base = base->base;
+	}
+
+	/* build what the base would otherwise build the first time one of
+	 * its overlays needed it, so that overlays in different threads only
+	 * ever read it
+	 */
+	gniggle_dictionary_settle(base);
+	r->base = gniggle_dictionary_ref(base);
+
+	return r;
+}
+
+void gniggle_dictionary_freeze(struct gniggle_dictionary *dict)
+{
+	if (dict->frozen == true)
+		return;
+
+	if (dict->backend == gniggle_backend_overlay) {
+		gniggle_dictionary_freeze(dict->base);
+		gniggle_dictionary_freeze(dict->added);
+		gniggle_dictionary_freeze(dict->removed);
+	}
+
+	gniggle_dictionary_settle(dict);
+	dict->frozen = true;
+}
+
+bool gniggle_dictionary_frozen(struct gniggle_dictionary *dict)
+{
+	return dict->frozen;
+}
+
+struct gniggle_dictionary_live *gniggle_dictionary_live_new(
+					struct gniggle_dictionary *dict)
+{
+	struct gniggle_dictionary_live *r =
+		calloc(sizeof(struct gniggle_dictionary_live), 1);
+
+	pthread_mutex_init(&r->lock, NULL);
+	gniggle_dictionary_freeze(dict);
+	r->dict = dict;
+
+	return r;
+}
+
+struct gniggle_dictionary *gniggle_dictionary_live_get(
+					struct gniggle_dictionary_live *live)
+{
+	struct gniggle_dictionary *r;
+
+	pthread_mutex_lock(&live->lock);
+	r = gniggle_dictionary_ref(live->dict);
+	pthread_mutex_unlock(&live->lock);
+
+	return r;
+}
+
+void gniggle_dictionary_live_swap(struct gniggle_dictionary_live *live,
+					struct gniggle_dictionary *dict)
+{
+	struct gniggle_dictionary *old;
+
+	/* the slow part happens before anyone else can see it */
+	gniggle_dictionary_freeze(dict);
+
+	pthread_mutex_lock(&live->lock);
+	old = live->dict;
+	live->dict = dict;
+	pthread_mutex_unlock(&live->lock);
+
+	gniggle_dictionary_delete(old);
+}
+
+bool gniggle_dictionary_live_reload(struct gniggle_dictionary_live *live,
+					const char *filename)
+{
+	struct gniggle_dictionary *cur = gniggle_dictionary_live_get(live);
+	struct gniggle_dictionary *d;
+
+	d = gniggle_dictionary_new_from_file_backend(cur->gx, cur->gy,
+		cur->nwords, filename,
+		cur->backend == gniggle_backend_trie ? gniggle_backend_trie :
+						gniggle_backend_hash);
+	if (d != NULL && cur->filterbits != 0)
+		gniggle_dictionary_set_filter(d, cur->filterbits);
+	gniggle_dictionary_delete(cur);
+
+	if (d == NULL)
+		return false;
+
+	gniggle_dictionary_live_swap(live, d);
+
+	return true;
+}
+
+void gniggle_dictionary_live_delete(struct gniggle_dictionary_live *live)
+{
+	gniggle_dictionary_delete(live->dict);
+	pthread_mutex_destroy(&live->lock);
+	free(live);
+}
+
 #ifdef TEST_RIG
 #include <stdio.h>
 
@@ -27,9 +27,85 @@
 #define __DICTIONARY_H__
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct gniggle_dictionary;
 struct gniggle_dictionary_iter;
+struct gniggle_dictionary_live;
+
+/* a position part way through spelling out words in a dictionary, used to
+ * walk it one letter at a time.  Treat the contents as private.
+ */
+struct gniggle_dictionary_cursor {
+	unsigned int node;
+	unsigned int rank;
+	unsigned int layer[3][2];
+};
+
+/* a run of words in a dictionary, by rank, to be visited in alphabetical
+ * order.  It needs nothing beyond the structure itself, so it can live on
+ * the stack.  Treat the contents as private.
+ */
+struct gniggle_dictionary_range {
+	struct gniggle_dictionary *dict;
+	unsigned int rank;
+	unsigned int end;
+};
+
+/* counts of how well a dictionary's lookup filter is doing.  Lookups that
+ * the filter can't rule out still have to look in the dictionary, and if the
+ * word isn't there either, that was a false positive.
+ */
+struct gniggle_dictionary_filter_stats {
+	unsigned long lookups;		/* lookups made with the filter */
+	unsigned long rejected;		/* misses answered by the filter */
+	unsigned long false_positives;	/* misses the filter let through */
+};
+
+/* how a dictionary stores its words.
+ * gniggle_backend_hash: A hash table of strings.  Quick to build and to look
+ *				words up in.
+ * gniggle_backend_trie: A letter trie with shared tails (a DAWG).  Much
+ *				smaller, and iterates in alphabetical order.
+ * gniggle_backend_overlay: Words added to and removed from another
+ *				dictionary, without copying it.
+ */
+typedef enum {
+	gniggle_backend_hash,
+	gniggle_backend_trie,
+	gniggle_backend_overlay
+} gniggle_dictionary_backend;
+
+/* a description of how a dictionary is laid out and how much memory it uses,
+ * filled in by gniggle_dictionary_stats().  Probe lengths count the slots
+ * looked at, so a word found in its first choice of slot has a probe length
+ * of one.  A lookup for a missing word has to cross the whole run of full
+ * slots it lands in, so the longest run bounds the cost of a miss.  The
+ * byte counts are for memory the dictionary allocated itself; node arrays
+ * used in place from a mapped image or the program's own data are counted
+ * separately, as shared.  An overlay's figures are for its own changes, not
+ * its base, which may be shared with others and can be asked separately.
+ */
+struct gniggle_dictionary_stats {
+	gniggle_dictionary_backend backend;
+	unsigned int words;		/* number of words */
+	unsigned int slots;		/* hash slots, or zero for no table */
+	unsigned int used_slots;	/* slots holding a word */
+	unsigned int load;		/* percentage of slots used */
+	unsigned int longest_probe;	/* longest probe to find a word */
+	unsigned int mean_probe;	/* average probe, times 100 */
+	unsigned int longest_run;	/* longest run of full slots */
+	unsigned int long_words;	/* words too long to fit in a slot */
+	unsigned int nodes;		/* trie or prefix index nodes */
+	size_t table_bytes;		/* hash slots and their signatures */
+	size_t string_bytes;		/* arena blocks for long words */
+	size_t node_bytes;		/* trie or prefix index */
+	size_t index_bytes;		/* words in alphabetical order */
+	size_t filter_bytes;		/* Bloom filter */
+	size_t total_bytes;		/* all of the above and the rest */
+	size_t shared_bytes;		/* nodes used in place */
+};
 
 /* returns a new string where any letters following Qs have been removed */
 char *gniggle_dictionary_trim_qu(const char *word);
@@ -37,30 +113,114 @@ char *gniggle_dictionary_trim_qu(const char *word);
 /* returns a new string where any Qs are replaced with QU */
 char *gniggle_dictionary_restore_qu(const char *word);
 
+/* words are converted into a buffer of this many bytes on the stack if
+ * they fit, which nearly all do, and into one from malloc() otherwise
+ */
+#define GNIGGLE_WORD_STACK 128
+
+/* as gniggle_dictionary_trim_qu(), but writes the result into 'out', which
+ * must have room for strlen(word) + 1 bytes.  Returns the result's length.
+ */
+size_t gniggle_dictionary_trim_qu_into(const char *word, char *out);
+
+/* as gniggle_dictionary_restore_qu(), but writes the result into 'out',
+ * which must have room for strlen(word) * 2 + 1 bytes.  Returns the result's
+ * length.
+ */
+size_t gniggle_dictionary_restore_qu_into(const char *word, char *out);
+
 /* returns true if a word can be considered a legal play should the letters
  * be available
  */
 bool gniggle_dictionary_word_qualifies(const char *word, const int maxlen);
 
-/* create a new dictionary for a grid of x by y.  You can also select a hash
- * size for the number of buckets to use.  Using zero here uses a largish
- * default value
+/* checks the 'len' characters at 'word' in the same way as
+ * gniggle_dictionary_word_qualifies(), and if they qualify, writes them to
+ * 'out' with their "qu"s trimmed, ready for gniggle_dictionary_lookup() and
+ * friends.  Returns the trimmed length, or -1 if the word does not qualify.
+ * 'out' must have room for len + 1 bytes, or may be NULL to only check the
+ * word.  'word' need not be NUL terminated.  Nothing is allocated.
+ */
+int gniggle_dictionary_normalise_into(const char *word, size_t len,
+					char *out, const unsigned int maxlen);
+
+/* returns a word's letter signature: bit 0 is set if it contains an A, bit 1
+ * if it contains a B, and so on.  A word can only be spelt from a set of
+ * letters if GNIGGLE_SIGNATURE_FITS(word's signature, letters' signature).
+ */
+unsigned int gniggle_dictionary_signature(const char *word);
+
+#define GNIGGLE_SIGNATURE_FITS(word, letters) (((word) & ~(letters)) == 0)
+
+/* create a new dictionary for a grid of x by y.  The hash table grows as
+ * words are added, but if you know roughly how many words to expect, passing
+ * it as the hash size avoids growing it along the way.  Zero is fine.
  */
 struct gniggle_dictionary *gniggle_dictionary_new(const unsigned int x,
 					const unsigned int y,
 					const unsigned int hashsize);
 
+/* sets how full, as a percentage, a hash dictionary's table may get before
+ * it is grown.  Lower values make lookups a little quicker at the cost of
+ * memory.  It is clamped between 10 and 95, and the default is 75.  Has no
+ * effect on trie dictionaries.
+ */
+void gniggle_dictionary_set_load(struct gniggle_dictionary *dict,
+					const unsigned int percent);
+
+/* puts a Bloom filter in front of gniggle_dictionary_lookup(), using about
+ * 'bits' bits of memory per word, so that most words that aren't in the
+ * dictionary are turned away without looking.  Each extra bit per word cuts
+ * the false positive rate by around 40%; 10 gives about 1%.  The filter
+ * is built at the next lookup, and zero removes it.  This also resets the
+ * filter's counters.
+ */
+void gniggle_dictionary_set_filter(struct gniggle_dictionary *dict,
+					const unsigned int bits);
+
+/* fills in 'stats' with how the filter has done since it was set.  The
+ * counts are not kept under a lock, so are only approximate if several
+ * threads share the dictionary, and they stop once it is frozen.
+ */
+void gniggle_dictionary_filter_stats(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_filter_stats *stats);
+
+/* create a new dictionary for a grid of x by y that stores its words in a
+ * trie rather than a hash table
+ */
+struct gniggle_dictionary *gniggle_dictionary_new_trie(const unsigned int x,
+					const unsigned int y);
+
+/* create a dictionary that starts with the same words as 'base', but keeps
+ * its own record of words added to or removed from it, leaving 'base'
+ * untouched.  It needs memory only for the changes, so many can share one
+ * base.  'base' must not be changed while the overlay exists, but the
+ * overlay holds a reference to it, so it may be deleted.  An overlay of an
+ * overlay takes a copy of its changes and shares its base.  Everything the
+ * base builds when first needed is built here, so overlays of one base may
+ * be used from different threads, each by one thread at a time; freezing
+ * the base (see gniggle_dictionary_freeze()) also stops it being changed.
+ */
+struct gniggle_dictionary *gniggle_dictionary_new_overlay(
+					struct gniggle_dictionary *base);
+
+/* returns which backend a dictionary is using */
+gniggle_dictionary_backend gniggle_dictionary_get_backend(
+					struct gniggle_dictionary *dict);
+
 /* loads a named file into the dictionary.  The file must consist of one
  * word per line, in plain ASCII.  Returns the number of words it scanned
  * (which is different to the number of words inserted into the dictionary)
- * or -1 in case of error.
+ * or -1 in case of error.  Large files are mapped into memory and checked
+ * on several threads at once, one per processor.
  */
 int gniggle_dictionary_load_file(struct gniggle_dictionary *dict,
 					const char *filename);
 
 /* create a new dictionary using a file as a reference.  This call supports
- * both plain-text dictionaries, and ones created with the dump function.
- * The hash size is ignored when undumping binary dictionaries.
+ * plain-text dictionaries, ones created with the dump function and mapped
+ * images.  The hash size is ignored when undumping binary dictionaries, and
+ * mapped images always give a trie dictionary.
  */
 struct gniggle_dictionary *gniggle_dictionary_new_from_file(
 					const unsigned int x,
@@ -68,14 +228,87 @@ struct gniggle_dictionary *gniggle_dictionary_new_from_file(
 					const unsigned int hashsize,
 					const char *filename);
 
-/* deletes a dictionary from memory, including its hash table */
+/* as above, but the words are loaded into a trie dictionary */
+struct gniggle_dictionary *gniggle_dictionary_new_trie_from_file(
+					const unsigned int x,
+					const unsigned int y,
+					const char *filename);
+
+/* deletes a dictionary from memory, including its hash table.  If other
+ * references to it were taken with gniggle_dictionary_ref(), this just drops
+ * one of them, and the last one to go deletes it.
+ */
 void gniggle_dictionary_delete(struct gniggle_dictionary *dict);
 
+/* makes a dictionary read only.  Everything it would otherwise build the
+ * first time it is needed is built now, and from then on nothing changes
+ * it: adding, removing, loading and changing its settings do nothing (and
+ * remove and load return false and -1), and lookups stop counting filter
+ * statistics.  Any number of threads may then use it at once without
+ * locks, through lookup, prefix lookup, cursors, words by rank or ID,
+ * ranges, iterators and the solver.  It can't be thawed.  Freezing an
+ * overlay freezes its base as well.
+ */
+void gniggle_dictionary_freeze(struct gniggle_dictionary *dict);
+
+/* returns true if the dictionary has been frozen */
+bool gniggle_dictionary_frozen(struct gniggle_dictionary *dict);
+
+/* takes another reference to a dictionary, which must be given up with
+ * gniggle_dictionary_delete().  Returns 'dict'.  Games take one to the
+ * dictionary they are played with, so it lasts as long as they do.  It is
+ * safe to take and give up references from different threads.
+ */
+struct gniggle_dictionary *gniggle_dictionary_ref(
+					struct gniggle_dictionary *dict);
+
+/* A live dictionary holds the dictionary new games should use, and lets it
+ * be replaced while games using the old one carry on.  Dictionaries handed
+ * to it are frozen (see gniggle_dictionary_freeze()) before they are
+ * swapped in, so that threads sharing them only ever read them.  Every
+ * function here may be called from any thread.
+ */
+
+/* creates a live dictionary, which takes over the caller's reference to
+ * 'dict'
+ */
+struct gniggle_dictionary_live *gniggle_dictionary_live_new(
+					struct gniggle_dictionary *dict);
+
+/* returns a reference to the current dictionary, to be given up with
+ * gniggle_dictionary_delete() when finished with
+ */
+struct gniggle_dictionary *gniggle_dictionary_live_get(
+					struct gniggle_dictionary_live *live);
+
+/* makes 'dict' the current dictionary, taking over the caller's reference to
+ * it.  The old one is deleted once nothing else refers to it.
+ */
+void gniggle_dictionary_live_swap(struct gniggle_dictionary_live *live,
+					struct gniggle_dictionary *dict);
+
+/* loads a file as gniggle_dictionary_new_from_file() does, using the same
+ * grid size, backend and filter as the current dictionary, and swaps it in.
+ * The old dictionary stays current while the file is read.  Returns false,
+ * leaving things as they were, if the file could not be read.
+ */
+bool gniggle_dictionary_live_reload(struct gniggle_dictionary_live *live,
+					const char *filename);
+
+/* deletes a live dictionary, giving up its reference to the current one */
+void gniggle_dictionary_live_delete(struct gniggle_dictionary_live *live);
+
 /* adds a word to a dictionary, making sure first that it isn't already there.
  * any "qu" will be trimmed to just "q" before being added.
  */
 void gniggle_dictionary_add(struct gniggle_dictionary *dict,
 				const char *word);
+
+/* removes a word from a dictionary.  As with adding, any "qu" will be
+ * trimmed to just "q" first.  Returns true if the word was there.
+ */
+bool gniggle_dictionary_remove(struct gniggle_dictionary *dict,
+				const char *word);
 				
 /* returns true if 'word' is in dictionary.  The word must be lower case,
  * and already have any "qu" converted to just "q".
@@ -83,9 +316,79 @@ void gniggle_dictionary_add(struct gniggle_dictionary *dict,
 bool gniggle_dictionary_lookup(struct gniggle_dictionary *dict,
 				const char *word);
 
+/* returns true if any word in the dictionary starts with 'prefix', including
+ * 'prefix' itself.  The same rules about case and "qu" apply as for lookup.
+ * Hash dictionaries build an index for this the first time it is needed.
+ */
+bool gniggle_dictionary_lookup_prefix(struct gniggle_dictionary *dict,
+				const char *prefix);
+
+/* sets 'cursor' to the start of every word in the dictionary */
+void gniggle_dictionary_cursor_init(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_cursor *cursor);
+
+/* moves on from 'from' by one letter, storing the result in 'to'.  Returns
+ * false, leaving 'to' alone, if no word in the dictionary carries on with
+ * that letter.  'from' and 'to' may be the same.
+ */
+bool gniggle_dictionary_cursor_step(struct gniggle_dictionary *dict,
+				const struct gniggle_dictionary_cursor *from,
+				const char letter,
+				struct gniggle_dictionary_cursor *to);
+
+/* returns true if the letters walked so far make up a whole word */
+bool gniggle_dictionary_cursor_word(struct gniggle_dictionary *dict,
+				const struct gniggle_dictionary_cursor *cursor);
+
+/* returns the rank of the word walked so far, being its position in the
+ * dictionary in alphabetical order, starting from zero.  Only meaningful
+ * when gniggle_dictionary_cursor_word() is true.
+ */
+#define gniggle_dictionary_cursor_rank(cursor) ((cursor)->rank)
+
+/* Every word in a dictionary has a numeric ID, which is just its rank, so
+ * they run from zero to one less than the number of words.  Adding or
+ * removing words changes them, so they should only be kept while the
+ * dictionary stays the same.  GNIGGLE_NO_WORD is never a word's ID.
+ */
+#define GNIGGLE_NO_WORD 0xffffffffu
+
+/* returns the ID of a word, or GNIGGLE_NO_WORD if it's not in the dictionary.
+ * As with gniggle_dictionary_lookup(), "qu" must already be trimmed to "q",
+ * and the dictionary's filter, if it has one, is asked first and counted.
+ */
+uint32_t gniggle_dictionary_id(struct gniggle_dictionary *dict,
+				const char *word);
+
+/* returns the words with the given IDs as an array terminated by NULL.  The
+ * words are stored in the same block as the array, so it should be freed
+ * with a single call to free().
+ */
+const char **gniggle_dictionary_words(struct gniggle_dictionary *dict,
+				const uint32_t *ids, const unsigned int n);
+
+/* returns the word with the given rank, or NULL if there are not that many
+ * words.  Trie dictionaries spell it out into 'buffer', which must have
+ * room for the longest word in the dictionary and a terminator; hash
+ * dictionaries return their own copy instead.  The first call on a hash
+ * dictionary sorts its words, and adding to it throws the order away.
+ */
+const char *gniggle_dictionary_word(struct gniggle_dictionary *dict,
+				const unsigned int rank, char *buffer);
+
+/* fills in 'stats' for a dictionary.  This looks at every hash slot, so it
+ * takes about as long as iterating the dictionary.  Nothing is built that
+ * isn't already there, and it may be used on frozen dictionaries.
+ */
+void gniggle_dictionary_stats(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_stats *stats);
+
 /* returns the number of words in a dictionary */
 unsigned int gniggle_dictionary_size(struct gniggle_dictionary *dict);
 
+/* returns the length of the longest word in the dictionary */
+unsigned int gniggle_dictionary_maxlen(struct gniggle_dictionary *dict);
+
 /* return an interator structure to be passed to the next function.  It is
  * undefined what happens if you add to the dictionary while iterating it.
  */				
@@ -93,19 +396,144 @@ struct gniggle_dictionary_iter *gniggle_dictionary_iterator(
 				struct gniggle_dictionary *dict);
 
 /* returns the next word from the dictionary via an iterator, or NULL if there
- * are no more words.  Words are returned in hash order, and are unsorted.
+ * are no more words.  Hash dictionaries return words in hash order, and they
+ * are unsorted.  Trie dictionaries return words in alphabetical order, but
+ * the string is only valid until the next call.
  */				
 const char *gniggle_dictionary_next(struct gniggle_dictionary_iter *iter);
 
+/* as gniggle_dictionary_next(), but also returns the word's letter
+ * signature, which hash dictionaries store alongside each word
+ */
+const char *gniggle_dictionary_next_signature(
+				struct gniggle_dictionary_iter *iter,
+				unsigned int *signature);
+
+/* return an iterator over just the words beginning with 'prefix', which
+ * returns them in alphabetical order whatever the backend.  Pass an empty
+ * prefix to iterate the whole dictionary in order.
+ */
+struct gniggle_dictionary_iter *gniggle_dictionary_iterator_prefix(
+				struct gniggle_dictionary *dict,
+				const char *prefix);
+
 /* deletes an iterator from memory once you are done with it */
 void gniggle_dictionary_iterator_delete(struct gniggle_dictionary_iter *iter);
 
-/* dumps a dictionary to a file in a binary format which is quicker to load */
+/* sets up a range over the words ranked from 'first' up to but not
+ * including 'end', clamped to the size of the dictionary
+ */
+void gniggle_dictionary_range_init(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_range *range,
+				const unsigned int first, const unsigned int end);
+
+/* sets up a range over part number 'part' of the dictionary, counting from
+ * zero, when split into 'parts' nearly equal parts.  Giving each of several
+ * threads its own part shares out the whole dictionary between them.  A
+ * 'parts' of zero is taken as one, and a 'part' past the last gives an empty
+ * range.
+ */
+void gniggle_dictionary_range_split(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_range *range,
+				const unsigned int part, const unsigned int parts);
+
+/* sets up a range over the words beginning with 'prefix'.  Returns false,
+ * leaving the range empty, if there are none.
+ */
+bool gniggle_dictionary_range_prefix(struct gniggle_dictionary *dict,
+				struct gniggle_dictionary_range *range,
+				const char *prefix);
+
+/* returns the next word in a range, or NULL once there are no more.  As with
+ * gniggle_dictionary_word(), 'buffer' must have room for the longest word
+ * and a terminator, and the word returned may or may not be in it.  Ranges
+ * allocate nothing, so there is nothing to delete.
+ */
+const char *gniggle_dictionary_range_next(
+				struct gniggle_dictionary_range *range,
+				char *buffer);
+
+/* dumps a dictionary to a file in a binary format which is quicker to load,
+ * with all of the optional sections below.  Returns 0 on success, or -1 on
+ * error.
+ */
 int gniggle_dictionary_dump(struct gniggle_dictionary *dict,
 				const char *filename);
+
+/* optional parts of a dump, saving work when it is loaded.
+ * GNIGGLE_DUMP_SORTED: Words are written in alphabetical order, so hash
+ *			dictionaries needn't sort them again.
+ * GNIGGLE_DUMP_SIGNATURES: Each word's letter signature.
+ * GNIGGLE_DUMP_LENGTHS: How many words there are of each length, which lets
+ *			the loader allocate room for them all at once.
+ */
+#define GNIGGLE_DUMP_SORTED 1
+#define GNIGGLE_DUMP_SIGNATURES 2
+#define GNIGGLE_DUMP_LENGTHS 4
+#define GNIGGLE_DUMP_ALL 7
+
+/* as gniggle_dictionary_dump(), but 'sections' chooses which of the
+ * optional sections to include
+ */
+int gniggle_dictionary_dump_sections(struct gniggle_dictionary *dict,
+				const char *filename,
+				const unsigned int sections);
  
-/* undumps a dictionary from a file, creating a new dictionary */
+/* undumps a dictionary from a file, creating a new dictionary.  Both the
+ * current and original dump formats can be read.  Returns NULL if the file
+ * is not a dump, fails its checksum, holds a different number of words
+ * than it claims, or has words too long for the grid it was made for.
+ * When the grid is smaller than that one, words too long for it are left
+ * out.
+ */
 struct gniggle_dictionary * gniggle_dictionary_undump(const unsigned int x,
     				const unsigned int y, const char *filename);
 
+/* writes a dictionary out as an image that gniggle_dictionary_map() can use
+ * in place.  The image is independent of the machine's byte order.
+ * Returns 0 on success, or -1 on error.
+ */
+int gniggle_dictionary_dump_mapped(struct gniggle_dictionary *dict,
+				const char *filename);
+
+/* maps an image written by gniggle_dictionary_dump_mapped() read-only into
+ * memory, and returns a trie dictionary that looks words up directly in it.
+ * Nothing is read or allocated per word, and the pages are shared with any
+ * other process using the same image.  Adding a word makes a private copy.
+ * A damaged image may give the wrong words, but is never read outside.
+ */
+struct gniggle_dictionary *gniggle_dictionary_map(const unsigned int x,
+				const unsigned int y, const char *filename);
+
+/* returns a trie dictionary that uses a node array already in memory, as
+ * laid out in a mapped image.  The nodes and, if not NULL, their word counts
+ * are used where they lie and never freed.  This is mostly for the source
+ * written by gniggle_dictionary_dump_source().
+ */
+struct gniggle_dictionary *gniggle_dictionary_new_static(
+				const unsigned int x,
+				const unsigned int y,
+				const void *nodes,
+				const unsigned int nnodes,
+				const uint32_t *counts,
+				const unsigned int nwords,
+				const unsigned int maxlen);
+
+/* writes C source that defines gniggle_dictionary_embedded(), which gives a
+ * dictionary of the words in 'dict' with no file access and nothing to load.
+ * If 'dict' is NULL, gniggle_dictionary_embedded() just returns NULL.  The
+ * source only works on machines with the same byte order as this one.
+ * Returns 0 on success, or -1 on error.
+ */
+int gniggle_dictionary_dump_source(struct gniggle_dictionary *dict,
+				const char *filename);
+
+/* returns the dictionary that was built into the library, or NULL if none
+ * was.  It can be freed with gniggle_dictionary_delete() as usual.  Build it
+ * in with "make embed EMBED_WORDS=file".  Its words were chosen for the grid
+ * size the library was built with, so words too long for x by y may remain.
+ */
+struct gniggle_dictionary *gniggle_dictionary_embedded(const unsigned int x,
+				const unsigned int y);
+
 #endif /* __DICTIONARY_H__ */
@@ -38,9 +38,47 @@ static void usage(char *argv[])
 	printf("Options are:\n");
 	printf("   -x width\n");
 	printf("   -y height\n");
-	printf("   -d dictionary\n");
+	printf("   -d dictionary (default is the built in one, if any, or\n");
+	printf("      /usr/share/dict/words)\n");
 	printf("   -g grid contents\n");
 	printf("   -c dictionary dump to create\n");
+	printf("   -m mapped dictionary image to create\n");
+	printf("   -t store the dictionary in a trie (takes no parameter)\n");
+	printf("   -s print memory and layout statistics for the dictionary\n");
+	printf("      and game, then exit (takes no parameter)\n");
+}
+
+static void show_stats(struct gniggle_dictionary *d, struct gniggle_game *g)
+{
+	struct gniggle_dictionary_stats s;
+	static const char *backends[] = { "hash", "trie", "overlay" };
+
+	gniggle_dictionary_stats(d, &s);
+
+	printf("dictionary:\n");
+	printf("  backend         %s\n", backends[s.backend]);
+	printf("  words           %u\n", s.words);
+	if (s.slots != 0) {
+		printf("  hash slots      %u (%u used, %u%% load)\n",
+			s.slots, s.used_slots, s.load);
+		printf("  probe length    %u.%02u average, %u longest\n",
+			s.mean_probe / 100, s.mean_probe % 100,
+			s.longest_probe);
+		printf("  longest run     %u slots\n", s.longest_run);
+		printf("  long words      %u\n", s.long_words);
+	}
+	printf("  nodes           %u\n", s.nodes);
+	printf("  table bytes     %lu\n", (unsigned long)s.table_bytes);
+	printf("  string bytes    %lu\n", (unsigned long)s.string_bytes);
+	printf("  node bytes      %lu\n", (unsigned long)s.node_bytes);
+	printf("  index bytes     %lu\n", (unsigned long)s.index_bytes);
+	printf("  filter bytes    %lu\n", (unsigned long)s.filter_bytes);
+	printf("  total bytes     %lu\n", (unsigned long)s.total_bytes);
+	printf("  shared bytes    %lu\n", (unsigned long)s.shared_bytes);
+
+	printf("game:\n");
+	printf("  answers         %u\n", g->nanswers);
+	printf("  bytes           %lu\n", (unsigned long)gniggle_game_memory(g));
 }
 
 static int cube_index(
@@ -99,19 +137,30 @@ int main(int argc, char *argv[])
 {
 	unsigned int width = 4, height = 4;
 	unsigned int rotation = 0;
-	char *dump = NULL, *grid = NULL, *dictionary = NULL;
+	char *dump = NULL, *map = NULL, *grid = NULL, *dictionary = NULL;
 	char word[BUFSIZ];
 	int a, w = 0;
 	struct gniggle_game *g;
 	struct gniggle_dictionary *d;
-	bool quit = false;
+	bool quit = false, trie = false, stats = false;
 	unsigned int score = 0, mscore = 0;
 	const char **answers;
+	char *qu;
 	
 	if (argc > 1) {
 		for (a = 1; a < argc; a++) {
 			if (argv[a][0] == '-') {
-				/* all need a parameter */
+				if (argv[a][1] == 't') {
+					trie = true;
+					continue;
+				}
+
+				if (argv[a][1] == 's') {
+					stats = true;
+					continue;
+				}
+
+				/* all others need a parameter */
 				if (a == argc) {
 					usage(argv);
 					exit(1);
@@ -138,6 +187,10 @@ int main(int argc, char *argv[])
 					dump = strdup(argv[a + 1]);
 					a++;
 					break;
+				case 'm':
+					map = strdup(argv[a + 1]);
+					a++;
+					break;
 				default:
 					usage(argv);
 					exit(1);
@@ -146,8 +199,6 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (dictionary == NULL)
-		dictionary = strdup("/usr/share/dict/words");
 			
 	if (grid == NULL) {
 		switch (width * height) {
@@ -162,11 +213,30 @@ int main(int argc, char *argv[])
 		}
 	}
 		
-	printf("loading dictionary... "); fflush(stdout);
-	d = gniggle_dictionary_new_from_file(width, height, 0, dictionary);
+	/* use the built in dictionary if there is one and no other was
+	 * asked for
+	 */
+	d = NULL;
+	if (dictionary == NULL) {
+		d = gniggle_dictionary_embedded(width, height);
+		if (d == NULL)
+			dictionary = strdup("/usr/share/dict/words");
+	}
+
 	if (d == NULL) {
-		fprintf(stderr, "unable to open %s\n", dictionary);
-		exit(1);
+		printf("loading dictionary... "); fflush(stdout);
+		if (trie == true)
+			d = gniggle_dictionary_new_trie_from_file(width,
+							height, dictionary);
+		else
+			d = gniggle_dictionary_new_from_file(width, height, 0,
+								dictionary);
+		if (d == NULL) {
+			fprintf(stderr, "unable to open %s\n", dictionary);
+			exit(1);
+		}
+	} else {
+		printf("using built in dictionary... ");
 	}
 
 	free(dictionary);
@@ -181,8 +251,26 @@ int main(int argc, char *argv[])
 		exit(1);
 	}	
 
+	if (map != NULL) {
+		printf("writing mapped image... "); fflush(stdout);
+		if (gniggle_dictionary_dump_mapped(d, map) == 0)
+			printf("done.\n");
+		else
+			printf("failed.\n");
+		gniggle_dictionary_delete(d);
+		exit(1);
+	}
+
 	g = gniggle_game_new(false, grid, width, height, d);
 	
+	if (stats == true) {
+		show_stats(d, g);
+		gniggle_game_delete(g);
+		gniggle_dictionary_delete(d);
+		free(grid);
+		exit(EXIT_SUCCESS);
+	}
+	
 	show_cube(grid, width, height, rotation);
 	
 	printf("Enter a . (a dot) on a line of its own to give up.\n");
@@ -208,11 +296,11 @@ int main(int argc, char *argv[])
 			rotation = (rotation + 1) % 4;
 			show_cube(grid, width, height, rotation);
 		} else {
-			size_t ll;
+			char *ll;
 		  	int wscore;
 			
-			for (ll = 0; ll < strlen(word); ll++)
-				word[ll] = tolower(word[ll]);
+			for (ll = word; *ll != '\0'; ll++)
+				*ll = tolower(*ll);
 
 			wscore = gniggle_game_try_word(g, word);
 
@@ -239,16 +327,19 @@ int main(int argc, char *argv[])
 	printf("Finding words you missed...\n"); fflush(stdout);
 	answers = g->answers;
 	
+	/* every answer fits on the board, so restoring its "qu"s can at most
+	 * double that
+	 */
+	qu = malloc(width * height * 2 + 1);
+	
 	for (a = 0; a >= 0 ; a++) {
 		if (answers[a] == NULL)
 			a = -2;
 		else {
-			if (gniggle_dictionary_lookup(g->found, answers[a])
+			if (gniggle_game_found_id(g, g->answer_ids[a])
 				== false) {
-				char *qu =
-					gniggle_dictionary_restore_qu(answers[a]);
+				gniggle_dictionary_restore_qu_into(answers[a], qu);
 				printf("%s\t\t", qu);
-				free(qu);
 				mscore += gniggle_game_word_score(
 					gniggle_score_traditional, answers[a]);
 				w += 1;
@@ -264,6 +355,7 @@ int main(int argc, char *argv[])
 	printf("\nYour score: %d.  You missed out on %d point%s.\n",
 			score, mscore, mscore == 1 ? "" : "s");
 
+	free(qu);
 	gniggle_game_delete(g);
 	gniggle_dictionary_delete(d);
 	free(grid);
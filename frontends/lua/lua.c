@@ -51,22 +51,32 @@ static bool luaL_checkboolean(lua_State *L, int index)
 
 static int l_gniggle_dict_trim_qu(lua_State *L)
 {
-	const unsigned char *in = luaL_checkstring(L, 1);
-	unsigned char *out = gniggle_dictionary_trim_qu(in);
+	size_t len;
+	const char *in = luaL_checklstring(L, 1, &len);
+	char stack[GNIGGLE_WORD_STACK], *out = stack;
 	
-	lua_pushstring(L, out);
-	free(out);
+	if (len >= sizeof(stack))
+		out = malloc(len + 1);
+	
+	lua_pushlstring(L, out, gniggle_dictionary_trim_qu_into(in, out));
+	if (out != stack)
+		free(out);
 
 	return 1;
 }
 
 static int l_gniggle_dict_restore_qu(lua_State *L)
 {
-	const unsigned char *in = luaL_checkstring(L, 1);
-	unsigned char *out = gniggle_dictionary_restore_qu(in);
+	size_t len;
+	const char *in = luaL_checklstring(L, 1, &len);
+	char stack[GNIGGLE_WORD_STACK], *out = stack;
+	
+	if (len * 2 >= sizeof(stack))
+		out = malloc(len * 2 + 1);
 	
-	lua_pushstring(L, out);
-	free(out);
+	lua_pushlstring(L, out, gniggle_dictionary_restore_qu_into(in, out));
+	if (out != stack)
+		free(out);
 
 	return 1;
 }
@@ -98,6 +108,22 @@ static int l_gniggle_dict_new(lua_State *L)
 	return 1;
 }
 
+static int l_gniggle_dict_new_trie(lua_State *L)
+{
+	const int sx = luaL_checknumber(L, 1);
+	const int sy = luaL_checknumber(L, 2);
+	
+	struct gniggle_dictionary **p = lua_newuserdata(L,
+		sizeof(struct gniggle_dictionary *));
+	
+	*p = gniggle_dictionary_new_trie(sx, sy);
+	
+	luaL_getmetatable(L, DICT_META_NAME);
+	lua_setmetatable(L, -2);
+	
+	return 1;
+}
+
 static int l_gniggle_dict_gc(lua_State *L)
 {
 	struct gniggle_dictionary **p = luaL_checkudata(L, 1, DICT_META_NAME);
@@ -107,6 +133,26 @@ static int l_gniggle_dict_gc(lua_State *L)
 	return 0;
 }
 
+static int l_gniggle_dict_set_load(lua_State *L)
+{
+	struct gniggle_dictionary **p = luaL_checkudata(L, 1, DICT_META_NAME);
+	const int percent = luaL_checknumber(L, 2);
+	
+	gniggle_dictionary_set_load(*p, percent);
+	
+	return 0;
+}
+
+static int l_gniggle_dict_set_filter(lua_State *L)
+{
+	struct gniggle_dictionary **p = luaL_checkudata(L, 1, DICT_META_NAME);
+	const int bits = luaL_checknumber(L, 2);
+	
+	gniggle_dictionary_set_filter(*p, bits);
+	
+	return 0;
+}
+
 static int l_gniggle_dict_load_file(lua_State *L)
 {
 	struct gniggle_dictionary **p = luaL_checkudata(L, 1, DICT_META_NAME);
@@ -138,6 +184,47 @@ static int l_gniggle_dict_new_from_file(lua_State *L)
 	return 1;
 }
 
+static int l_gniggle_dict_new_trie_from_file(lua_State *L)
+{
+	const int sx = luaL_checknumber(L, 1);
+	const int sy = luaL_checknumber(L, 2);
+	const char *fn = luaL_checkstring(L, 3);
+	
+	struct gniggle_dictionary **p = lua_newuserdata(L,
+		sizeof(struct gniggle_dictionary *));
+	
+	*p = gniggle_dictionary_new_trie_from_file(sx, sy, fn);
+	
+	if (*p == NULL)
+		return luaL_error(L, "Unable to load dictionary %s!", fn);
+	
+	luaL_getmetatable(L, DICT_META_NAME);
+	lua_setmetatable(L, -2);
+	
+	return 1;
+}
+
+static int l_gniggle_dict_new_embedded(lua_State *L)
+{
+	const int sx = luaL_checknumber(L, 1);
+	const int sy = luaL_checknumber(L, 2);
+	struct gniggle_dictionary *d = gniggle_dictionary_embedded(sx, sy);
+	struct gniggle_dictionary **p;
+	
+	if (d == NULL) {
+		lua_pushnil(L);
+		return 1;
+	}
+	
+	p = lua_newuserdata(L, sizeof(struct gniggle_dictionary *));
+	*p = d;
+	
+	luaL_getmetatable(L, DICT_META_NAME);
+	lua_setmetatable(L, -2);
+	
+	return 1;
+}
+
 static int l_gniggle_dict_add(lua_State *L)
 {
 	struct gniggle_dictionary **p = luaL_checkudata(L, 1, DICT_META_NAME);
@@ -158,6 +245,16 @@ static int l_gniggle_dict_lookup(lua_State *L)
 	return 1;
 }
 
+static int l_gniggle_dict_lookup_prefix(lua_State *L)
+{
+	struct gniggle_dictionary **p = luaL_checkudata(L, 1, DICT_META_NAME);
+	const char *w = luaL_checkstring(L, 2);
+	
+	lua_pushboolean(L, gniggle_dictionary_lookup_prefix(*p, w));
+	
+	return 1;
+}
+
 static int l_gniggle_dict_size(lua_State *L)
 {
 	struct gniggle_dictionary **p = luaL_checkudata(L, 1, DICT_META_NAME);
@@ -304,10 +401,16 @@ static const struct luaL_Reg gniggle[] = {
 	{ "dict_restore_qu", 	l_gniggle_dict_restore_qu },
 	{ "dict_word_qualifies", l_gniggle_dict_word_qualifies },
 	{ "dict_new", 		l_gniggle_dict_new },
+	{ "dict_new_trie", 	l_gniggle_dict_new_trie },
+	{ "dict_set_load", 	l_gniggle_dict_set_load },
+	{ "dict_set_filter", 	l_gniggle_dict_set_filter },
 	{ "dict_load_file", 	l_gniggle_dict_load_file },
 	{ "dict_new_from_file", l_gniggle_dict_new_from_file },
+	{ "dict_new_trie_from_file", l_gniggle_dict_new_trie_from_file },
+	{ "dict_new_embedded",	l_gniggle_dict_new_embedded },
 	{ "dict_add", 		l_gniggle_dict_add },
 	{ "dict_lookup", 	l_gniggle_dict_lookup },
+	{ "dict_lookup_prefix",	l_gniggle_dict_lookup_prefix },
 	{ "dict_size", 		l_gniggle_dict_size },
 	{ "dict_iter", 		l_gniggle_dict_iter },
 	{ "dict_next", 		l_gniggle_dict_next },
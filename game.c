@@ -25,10 +25,31 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "game.h"
 #include "dictionary.h"
 #include "solve.h"
 
+/* returns where a word is in the answer list, or -1 if it isn't */
+static int find_answer(struct gniggle_game *game, uint32_t id)
+{
+	unsigned int lo = 0, hi = game->nanswers, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (game->answer_ids[mid] == id)
+			return mid;
+		if (game->answer_ids[mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return -1;
+}
+
 unsigned int gniggle_game_word_score(gniggle_score_style style,
 					const char *word)
 {
@@ -64,17 +85,45 @@ unsigned int gniggle_game_word_score(gniggle_score_style style,
 	return 0;
 }
 
+unsigned int gniggle_game_id_score(struct gniggle_game *game,
+					gniggle_score_style style,
+					uint32_t id)
+{
+	char *buffer = malloc(gniggle_dictionary_maxlen(game->dict) + 1);
+	const char *word = gniggle_dictionary_word(game->dict, id, buffer);
+	unsigned int score = 0;
+
+	if (word != NULL)
+		score = gniggle_game_word_score(style, word);
+
+	free(buffer);
+
+	return score;
+}
+
 struct gniggle_game *gniggle_game_new(bool generate, const char *type,
 					unsigned int width,
 					unsigned int height,
 					struct gniggle_dictionary *dict)
+{
+	return gniggle_game_new_threaded(generate, type, width, height, dict,
+						1);
+}
+
+struct gniggle_game *gniggle_game_new_threaded(bool generate,
+					const char *type,
+					unsigned int width,
+					unsigned int height,
+					struct gniggle_dictionary *dict,
+					unsigned int threads)
 {
 	struct gniggle_game *r = calloc(sizeof(struct gniggle_game), 1);
 	
 	r->width = width;
 	r->height = height;
-	r->dict = dict;
-	r->found = gniggle_dictionary_new(width, height, 0);
+	r->dict = gniggle_dictionary_ref(dict);
+	r->found = calloc(1, gniggle_dictionary_size(dict) / 8 + 1);
+	r->nfound = 0;
 	r->score = 0;
 	
 	if (generate == false)
@@ -86,7 +135,10 @@ struct gniggle_game *gniggle_game_new(bool generate, const char *type,
 			r->grid = gniggle_generate_simple(type, width, height);
 	}
 	
-	r->answers = gniggle_game_get_answers(r);
+	r->answer_ids = gniggle_solve_grid_ids_threaded(dict, r->grid, width,
+					height, threads, &r->nanswers);
+	r->answers = gniggle_dictionary_words(dict, r->answer_ids,
+						r->nanswers);
 	
 	return r;
 }
@@ -95,81 +147,305 @@ void gniggle_game_delete(struct gniggle_game *game)
 {
 	free(game->grid);
 	free(game->answers);
-	gniggle_dictionary_delete(game->found);
+	free(game->answer_ids);
+	free(game->found);
+	gniggle_dictionary_delete(game->dict);
 	free(game);
 }
 
-static int gniggle_game_answers_sort(const void *p1, const void *p2)
+const char **gniggle_game_get_answers(struct gniggle_game *game)
 {
-	return strcmp(* (char * const *) p1, * (char * const *) p2);
+	return gniggle_solve_grid(game->dict, game->grid, game->width,
+					game->height);
 }
 
-const char **gniggle_game_get_answers(struct gniggle_game *game)
+struct gniggle_solve_routes *gniggle_game_get_routes(struct gniggle_game *game,
+					bool every)
 {
-	/* we allocate enough space for 64 words, including the sentinal.
-	 * we can extend this if there are more words.
-	 */
-	const char **r = calloc(sizeof(char *), 64);
-	struct gniggle_dictionary_iter *iter;
-	const char *word;
-	unsigned int room = 63, found = 0;
-	
-	iter = gniggle_dictionary_iterator(game->dict);
-	
-	while ((word = gniggle_dictionary_next(iter)) != NULL) {
-		if (gniggle_solve_word_on_grid(word, game->grid,
-				game->width, game->height, NULL) == true) {
-				r[found] = word;
-				found++;
-				room--;
-				if (room == 0) {
-					r = realloc(r, (found + 64) * 
-							sizeof(char *));
-					room = 63;
-				}
-						
+	return gniggle_solve_grid_routes(game->dict, game->grid, game->width,
+					game->height, every);
+}
+
+const char **gniggle_game_get_answers_threaded(struct gniggle_game *game,
+					unsigned int threads)
+{
+	return gniggle_solve_grid_threaded(game->dict, game->grid, game->width,
+					game->height, threads);
+}
+
+size_t gniggle_game_memory(struct gniggle_game *game)
+{
+	size_t r = sizeof(struct gniggle_game);
+	unsigned int a;
+
+	r += strlen(game->grid) + 1;
+	r += (game->nanswers + 1) * (sizeof(char *) + sizeof(uint32_t));
+	for (a = 0; a < game->nanswers; a++)
+		r += strlen(game->answers[a]) + 1;
+	r += gniggle_dictionary_size(game->dict) / 8 + 1;
+
+	return r;
+}
+
+/* Threads take boards in turn, solving each with their own scratch area and
+ * appending the IDs found to their own array.  Once all are done, each
+ * board's IDs are copied out into one array in board order.
+ */
+struct gniggle_game_batch_share {
+	pthread_mutex_t lock;		/* held to take a board */
+	unsigned int next;		/* next board to take */
+	const char **grids;
+	const uint16_t *scores;		/* score of each word, by ID */
+	struct gniggle_game_batch *batch;
+	unsigned int *owner;		/* which worker solved each board */
+	unsigned int *where;		/* where its IDs start in the worker's */
+};
+
+struct gniggle_game_batch_worker {
+	struct gniggle_solve_scratch *scratch;
+	struct gniggle_game_batch_share *share;
+	unsigned int index;
+	uint32_t *ids;
+	unsigned int nids, maxids;
+	pthread_t thread;
+	bool threaded;			/* thread needs joining */
+};
+
+static void *gniggle_game_batch_work(void *p)
+{
+	struct gniggle_game_batch_worker *worker = p;
+	struct gniggle_game_batch_share *share = worker->share;
+	struct gniggle_game_batch *batch = share->batch;
+	const uint32_t *ids;
+	unsigned int board, n, i, score;
+
+	for (;;) {
+		pthread_mutex_lock(&share->lock);
+		board = share->next++;
+		pthread_mutex_unlock(&share->lock);
+
+		if (board >= batch->nboards)
+			break;
+
+		n = gniggle_solve_grid_scratch(worker->scratch,
+						share->grids[board], &ids);
+
+		if (worker->nids + n > worker->maxids) {
+			worker->maxids = (worker->nids + n) * 2;
+			worker->ids = realloc(worker->ids,
+					worker->maxids * sizeof(uint32_t));
 		}
+
+		for (i = 0, score = 0; i < n; i++)
+			score += share->scores[ids[i]];
+		memcpy(worker->ids + worker->nids, ids, n * sizeof(uint32_t));
+
+		share->owner[board] = worker->index;
+		share->where[board] = worker->nids;
+		batch->start[board + 1] = n;
+		batch->score[board] = score;
+		worker->nids += n;
 	}
-	
-	r[found] = NULL;
-	
-	qsort(r, found, sizeof(char *), gniggle_game_answers_sort);
-	
-	free(iter);
-	
+
+	return NULL;
+}
+
+struct gniggle_game_batch *gniggle_game_solve_batch(
+					struct gniggle_dictionary *dict,
+					const char **grids,
+					unsigned int ngrids,
+					unsigned int width,
+					unsigned int height,
+					gniggle_score_style style,
+					unsigned int threads)
+{
+	struct gniggle_game_batch *r = calloc(sizeof(struct gniggle_game_batch),
+						1);
+	struct gniggle_game_batch_worker *workers;
+	struct gniggle_game_batch_share share;
+	struct gniggle_dictionary_range range;
+	uint16_t *scores;
+	char *buffer;
+	const char *word;
+	unsigned int i, id, board;
+
+	if (threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (cpus < 1) ? 1 : cpus;
+	}
+	if (threads > ngrids)
+		threads = (ngrids == 0) ? 1 : ngrids;
+
+	r->nboards = ngrids;
+	r->start = calloc(sizeof(unsigned int), ngrids + 1);
+	r->score = calloc(sizeof(unsigned int), ngrids + 1);
+
+	/* a word's score only depends on its letters, so work them all out
+	 * once rather than for every board the word is found on
+	 */
+	scores = malloc((gniggle_dictionary_size(dict) + 1) *
+				sizeof(uint16_t));
+	buffer = malloc(gniggle_dictionary_maxlen(dict) + 1);
+	gniggle_dictionary_range_init(dict, &range, 0,
+					gniggle_dictionary_size(dict));
+	for (id = 0; (word = gniggle_dictionary_range_next(&range, buffer))
+			!= NULL; id++)
+		scores[id] = gniggle_game_word_score(style, word);
+	free(buffer);
+
+	pthread_mutex_init(&share.lock, NULL);
+	share.next = 0;
+	share.grids = grids;
+	share.scores = scores;
+	share.batch = r;
+	share.owner = malloc((ngrids + 1) * sizeof(unsigned int));
+	share.where = malloc((ngrids + 1) * sizeof(unsigned int));
+
+	/* the scratch areas build anything the dictionary builds when first
+	 * needed, so the threads only read it
+	 */
+	workers = calloc(sizeof(struct gniggle_game_batch_worker), threads);
+	for (i = 0; i < threads; i++) {
+		workers[i].scratch = gniggle_solve_scratch_new(dict, width,
+								height);
+		workers[i].share = &share;
+		workers[i].index = i;
+		workers[i].maxids = 256;
+		workers[i].ids = malloc(workers[i].maxids * sizeof(uint32_t));
+	}
+
+	for (i = 1; i < threads; i++) {
+		workers[i].threaded = pthread_create(&workers[i].thread, NULL,
+				gniggle_game_batch_work, &workers[i]) == 0;
+	}
+	gniggle_game_batch_work(&workers[0]);
+	for (i = 1; i < threads; i++)
+		if (workers[i].threaded == true)
+			pthread_join(workers[i].thread, NULL);
+
+	/* each board's count was left in the slot after it, so adding them
+	 * up gives where each board's IDs start
+	 */
+	for (board = 0; board < ngrids; board++)
+		r->start[board + 1] += r->start[board];
+
+	r->ids = malloc((r->start[ngrids] + 1) * sizeof(uint32_t));
+	for (board = 0; board < ngrids; board++)
+		memcpy(r->ids + r->start[board],
+			workers[share.owner[board]].ids + share.where[board],
+			(r->start[board + 1] - r->start[board]) *
+				sizeof(uint32_t));
+
+	for (i = 0; i < threads; i++) {
+		gniggle_solve_scratch_delete(workers[i].scratch);
+		free(workers[i].ids);
+	}
+	free(workers);
+	free(share.owner);
+	free(share.where);
+	free(scores);
+	pthread_mutex_destroy(&share.lock);
+
+	return r;
+}
+
+void gniggle_game_batch_delete(struct gniggle_game_batch *batch)
+{
+	free(batch->start);
+	free(batch->score);
+	free(batch->ids);
+	free(batch);
+}
+
+uint32_t *gniggle_game_get_answer_ids(struct gniggle_game *game,
+					unsigned int *count)
+{
+	uint32_t *r = malloc((game->nanswers + 1) * sizeof(uint32_t));
+
+	memcpy(r, game->answer_ids, game->nanswers * sizeof(uint32_t));
+	*count = game->nanswers;
+
 	return r;
 }
 
+uint32_t *gniggle_game_get_found_ids(struct gniggle_game *game,
+					unsigned int *count)
+{
+	uint32_t *r = malloc((game->nfound + 1) * sizeof(uint32_t));
+	unsigned int a, n = 0;
+
+	/* everything found is an answer, so only those bits need looking at */
+	for (a = 0; a < game->nanswers; a++)
+		if (gniggle_game_found_id(game, game->answer_ids[a]) == true)
+			r[n++] = game->answer_ids[a];
+
+	*count = n;
+
+	return r;
+}
+
+bool gniggle_game_found_id(struct gniggle_game *game, uint32_t id)
+{
+	if (id >= gniggle_dictionary_size(game->dict))
+		return false;
+
+	return (game->found[id >> 3] & (1 << (id & 7))) != 0;
+}
+
+int gniggle_game_try_id(struct gniggle_game *game, uint32_t id)
+{
+	unsigned int score;
+	int a;
+
+	if (id == GNIGGLE_NO_WORD || id >= gniggle_dictionary_size(game->dict))
+		return -2;
+
+	a = find_answer(game, id);
+	if (a == -1)
+		return 0;
+
+	if (gniggle_game_found_id(game, id) == true)
+		return -1;
+
+	game->found[id >> 3] |= 1 << (id & 7);
+	game->nfound++;
+
+	score = gniggle_game_word_score(gniggle_score_traditional,
+					game->answers[a]);
+	game->score += score;
+
+	return score;
+}
+
 int gniggle_game_try_word(struct gniggle_game *game,
 					const char *word) {
 					
-	char *nqu = gniggle_dictionary_trim_qu(word);
-	unsigned int score;
+	char stack[GNIGGLE_WORD_STACK], *nqu = stack;
+	size_t len = strlen(word);
+	uint32_t id;
+	bool on = false;
 	
-	if (gniggle_solve_word_on_grid(nqu, game->grid, game->width,
-					game->height, NULL) == false)
-	{
-		free(nqu);
-		return 0;	
-	}
+	if (len >= sizeof(stack))
+		nqu = malloc(len + 1);
 	
-	if (gniggle_dictionary_lookup(game->found, nqu) == true) {
-		free(nqu);
-		return -1;
-	}
+	gniggle_dictionary_trim_qu_into(word, nqu);
+	id = gniggle_dictionary_id(game->dict, nqu);
 	
-	if (gniggle_dictionary_lookup(game->dict, nqu) == false) {
-		free(nqu);
-		return -2;
-	}
+	/* words in the dictionary are on the board exactly when they are
+	 * among the answers, so the board only needs searching for the
+	 * others, to tell them apart.
+	 */
+	if (id == GNIGGLE_NO_WORD)
+		on = gniggle_solve_word_on_grid(nqu, game->grid,
+					game->width, game->height, NULL);
 	
-	gniggle_dictionary_add(game->found, nqu);
+	if (nqu != stack)
+		free(nqu);
 	
-	score = gniggle_game_word_score(gniggle_score_traditional, nqu);
-	game->score += score;
-	free(nqu);
+	if (id == GNIGGLE_NO_WORD)
+		return on == true ? -2 : 0;
 	
-	return score;
+	return gniggle_game_try_id(game, id);
 }
 
 #ifdef TEST_RIG
@@ -180,9 +456,9 @@ int main(int argc, char *argv[])
 	struct gniggle_dictionary *d;
 	struct gniggle_game *g;
 	char word[BUFSIZ];
-	const unsigned char **answers;
-	int i, score = 0, wscore, j;
-	unsigned int path[64];
+	struct gniggle_solve_routes *routes;
+	int score = 0, wscore;
+	unsigned int i, j, cube;
 	
 	FILE *dict = fopen("dict", "r");
 	
@@ -199,25 +475,22 @@ int main(int argc, char *argv[])
 	
 	printf("\n");
 	
-	answers = gniggle_game_get_answers(g);
-
-	for (i = 0; i >= 0 ; i++) {
-		if (answers[i] == NULL)
-			i = -2;
-		else {
-			wscore = gniggle_game_word_score(gniggle_score_traditional, answers[i]);
-			printf("%s ( ");
-			gniggle_solve_word_on_grid(answers[i], g->grid, 4, 4, path);
-			for (j = 0; j < (strlen(answers[i]) * 2); j += 2)
-				printf("%d x %d  ", path[j], path[j + 1]);
-			printf(") (%d points)\n", wscore);
-			score += wscore;
+	routes = gniggle_game_get_routes(g, false);
+
+	for (i = 0; i < routes->count; i++) {
+		wscore = gniggle_game_word_score(gniggle_score_traditional, g->answers[i]);
+		printf("%s ( ", g->answers[i]);
+		for (j = 0; j < routes->length[i]; j++) {
+			cube = routes->cubes[routes->start[i] + j];
+			printf("%d x %d  ", cube % 4 + 1, cube / 4 + 1);
 		}
+		printf(") (%d points)\n", wscore);
+		score += wscore;
 	}
 	
 	printf("total score: %d\n", score);
 	
-	free(answers);
+	gniggle_solve_routes_delete(routes);
 	gniggle_game_delete(g);
 	gniggle_dictionary_delete(d);
 
@@ -28,6 +28,7 @@
 
 #include "dictionary.h"
 #include "generate.h"
+#include "solve.h"
 #include <stdbool.h>
 
 typedef enum {
@@ -42,8 +43,11 @@ struct gniggle_game {
 	char *grid;
 	unsigned int score;
 	const char **answers;
+	uint32_t *answer_ids;		/* IDs of answers, in the same order */
+	unsigned int nanswers;
 	struct gniggle_dictionary *dict;
-	struct gniggle_dictionary *found;
+	unsigned char *found;		/* a bit for each word ID in dict */
+	unsigned int nfound;
 };
 
 /* returns the score of a word using the specified scoring style.
@@ -56,28 +60,125 @@ struct gniggle_game {
 unsigned int gniggle_game_word_score(gniggle_score_style style,
 					const char *word);
 
+/* as gniggle_game_word_score(), but for the word with the given ID in the
+ * game's dictionary
+ */
+unsigned int gniggle_game_id_score(struct gniggle_game *game,
+					gniggle_score_style style,
+					uint32_t id);
+
 /* create a new game.  If generate is false, type is a string for the grid,
  * left to right, top to bottom.  If it is true, a random game is generated,
  * where type is used to select one of the letter distributions defined in
- * generate.h, or NULL to emulate a real Boggle dice set.
+ * generate.h, or NULL to emulate a real Boggle dice set.  The game takes a
+ * reference to the dictionary (see gniggle_dictionary_ref()), so the caller
+ * may delete its own once the game has started.
  */
 struct gniggle_game *gniggle_game_new(bool generate, const char *type,
 					unsigned int width,
 					unsigned int height,
 					struct gniggle_dictionary *dict);
 
+/* as gniggle_game_new(), but finds the game's answers using 'threads'
+ * threads, or one per processor if it is zero (see
+ * gniggle_solve_grid_ids_threaded()).  This is worth it for large boards.
+ */
+struct gniggle_game *gniggle_game_new_threaded(bool generate,
+					const char *type,
+					unsigned int width,
+					unsigned int height,
+					struct gniggle_dictionary *dict,
+					unsigned int threads);
+
 /* deletes an existing game, and frees all memory assoicated with it. */
 void gniggle_game_delete(struct gniggle_game *game);
 
-/* returns a string array with all valid words for this game.  It is the
- * caller's responsibility to free this.
+/* returns a string array with all valid words for this game.  The strings
+ * are stored in the same block as the array, so it is the caller's
+ * responsibility to free this with a single call to free().
  */
 const char **gniggle_game_get_answers(struct gniggle_game *game);
 
+/* returns the game's answers along with their routes on the grid, in the
+ * same order as its answers, keeping every route if 'every' is true and one
+ * for each word otherwise.  See gniggle_solve_grid_routes(), and free it
+ * with gniggle_solve_routes_delete().
+ */
+struct gniggle_solve_routes *gniggle_game_get_routes(struct gniggle_game *game,
+					bool every);
+
+/* as gniggle_game_get_answers(), but shares the work out between 'threads'
+ * threads, or one per processor if it is zero
+ */
+const char **gniggle_game_get_answers_threaded(struct gniggle_game *game,
+					unsigned int threads);
+
+/* the answers to many grids at once, without making a game for each.  The
+ * IDs of the words on board 'n' are ids[start[n]] up to but not including
+ * ids[start[n + 1]], in ascending order, and score[n] is the score for
+ * finding all of them.
+ */
+struct gniggle_game_batch {
+	unsigned int nboards;
+	unsigned int *start;		/* nboards + 1 of them */
+	unsigned int *score;
+	uint32_t *ids;
+};
+
+/* solves 'ngrids' grids of the same size, each a string as for
+ * gniggle_game_new(), scoring them in the given style.  The work is shared
+ * out between 'threads' threads, or one per processor if it is zero, and
+ * the memory used to solve one grid is reused for the next.  Long runs of
+ * grids can be passed in chunks of a few thousand at a time.  The
+ * dictionary must not change until this returns.  Free the result with
+ * gniggle_game_batch_delete().
+ */
+struct gniggle_game_batch *gniggle_game_solve_batch(
+					struct gniggle_dictionary *dict,
+					const char **grids,
+					unsigned int ngrids,
+					unsigned int width,
+					unsigned int height,
+					gniggle_score_style style,
+					unsigned int threads);
+
+/* deletes the results of gniggle_game_solve_batch() */
+void gniggle_game_batch_delete(struct gniggle_game_batch *batch);
+
+/* returns the IDs of all valid words for this game in ascending order, and
+ * stores the number of them in 'count'.  The array should be freed with
+ * free().
+ */
+uint32_t *gniggle_game_get_answer_ids(struct gniggle_game *game,
+					unsigned int *count);
+
+/* returns the IDs of the words found by the user so far in ascending order,
+ * and stores the number of them in 'count'.  The array should be freed with
+ * free().
+ */
+uint32_t *gniggle_game_get_found_ids(struct gniggle_game *game,
+					unsigned int *count);
+
+/* returns true if the user has found the word with the given ID */
+bool gniggle_game_found_id(struct gniggle_game *game, uint32_t id);
+
+/* returns the number of bytes of memory a game uses, not counting its
+ * dictionary, which may be shared with other games
+ */
+size_t gniggle_game_memory(struct gniggle_game *game);
+
 /* add a word to the list of words found by the user.  It returns the word's
  * score, zero if the word is not on the board, -1 if the word has already
- * been guessed, or -2 if the word is not in the dictionary.
+ * been guessed, or -2 if the word is not in the dictionary.  Words are
+ * tracked by their IDs, so the game's dictionary must not be changed while
+ * the game is being played.
  */
 int gniggle_game_try_word(struct gniggle_game *game,
 					const char *word);
+
+/* as gniggle_game_try_word(), but for a word already looked up with
+ * gniggle_dictionary_id().  Returns -2 for GNIGGLE_NO_WORD or an ID past
+ * the end of the dictionary.
+ */
+int gniggle_game_try_id(struct gniggle_game *game, uint32_t id);
 #endif /* __GAME_H__ */
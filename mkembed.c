@@ -0,0 +1,67 @@
+/*
+ * mkembed.c
+ * This file is part of Gniggle
+ *
+ * Copyright (C) 2006 - Rob Kendrick <rjek@rjek.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+ 
+
+/* Writes out the C source for the dictionary built into libgniggle.  With
+ * no word list it writes a stand-in that says there isn't one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dictionary.h"
+
+int main(int argc, char *argv[])
+{
+	struct gniggle_dictionary *d = NULL;
+	int r;
+
+	if (argc != 2 && argc != 5) {
+		fprintf(stderr, "usage: %s output.c [wordlist width height]\n",
+			argv[0]);
+		exit(1);
+	}
+
+	if (argc == 5) {
+		d = gniggle_dictionary_new_trie_from_file(atoi(argv[3]),
+							atoi(argv[4]), argv[2]);
+		if (d == NULL) {
+			fprintf(stderr, "unable to open %s\n", argv[2]);
+			exit(1);
+		}
+	}
+
+	r = gniggle_dictionary_dump_source(d, argv[1]);
+
+	if (d != NULL)
+		gniggle_dictionary_delete(d);
+
+	if (r != 0) {
+		fprintf(stderr, "unable to write %s\n", argv[1]);
+		exit(1);
+	}
+
+	return 0;
+}
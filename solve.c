@@ -24,73 +24,219 @@
  */
  
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <malloc.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "dictionary.h"
 #include "solve.h"
 
 bool gniggle_solve_sufficent_letters(const char *word, const char *grid)
 {
-	char *letters = strdup(grid);
-	size_t i;
-	
-	for (i = 0; i < strlen(word); i++) {
-		char *o = strchr(letters, word[i]);
-		if (o == NULL) {
-			free(letters);
+	unsigned int count[256];
+	const unsigned char *p;
+
+	/* most words fail on a letter that isn't there at all */
+	if (GNIGGLE_SIGNATURE_FITS(gniggle_dictionary_signature(word),
+			gniggle_dictionary_signature(grid)) == false)
+		return false;
+
+	memset(count, 0, sizeof(count));
+	for (p = (const unsigned char *)grid; *p != '\0'; p++)
+		count[*p]++;
+
+	for (p = (const unsigned char *)word; *p != '\0'; p++)
+		if (count[*p]-- == 0)
 			return false;
+
+	return true;
+}
+
+/* Boards of up to 64 cubes are solved on a bitboard: each cube is a bit in a
+ * 64 bit word, numbered left to right, top to bottom, so the cubes on a
+ * route, the cubes next to a cube and the cubes showing a letter are all
+ * masks, and the cubes a route can move on to are just their intersection.
+ * Larger boards fall back to walking the grid a cube at a time.
+ */
+#define GNIGGLE_SOLVE_BITS 64
+
+/* the letter code given to anything that isn't a to z */
+#define GNIGGLE_SOLVE_NOT_LETTER 31
+
+#define BIT(cube) ((uint64_t)1 << (cube))
+
+/* routes are kept as 16 bit cube numbers */
+#define GNIGGLE_SOLVE_MAX_CUBES 65536
+
+/* the neighbours of a cube, as rows and columns to add to its own.  Adding
+ * -1 to zero gives a row or column past the end of the board, so it gets
+ * skipped.
+ */
+static const int gniggle_solve_rows[8] = { -1, -1, -1,  0, 0,  1, 1, 1 };
+static const int gniggle_solve_cols[8] = { -1,  0,  1, -1, 1, -1, 0, 1 };
+
+struct gniggle_solve_board {
+	unsigned int width, height;
+	unsigned char letter[GNIGGLE_SOLVE_BITS];	/* letter codes */
+	uint64_t next[GNIGGLE_SOLVE_BITS];	/* cubes next to each cube */
+	uint64_t where[GNIGGLE_SOLVE_NOT_LETTER + 1];	/* cubes by letter */
+};
+
+/* returns the number of the lowest set bit in a non-zero mask */
+static unsigned int gniggle_solve_lowest(uint64_t mask)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(mask);
+#else
+	unsigned int r = 0;
+
+	while ((mask & 1) == 0) {
+		mask >>= 1;
+		r++;
+	}
+
+	return r;
+#endif
+}
+
+/* fills in a bitboard for a grid.  Returns false if the grid is too big to
+ * have one.
+ */
+static bool gniggle_solve_board_init(struct gniggle_solve_board *b,
+				const char *grid,
+				unsigned int width, unsigned int height)
+{
+	unsigned int row, col, cube;
+
+	if (width * height > GNIGGLE_SOLVE_BITS)
+		return false;
+
+	b->width = width;
+	b->height = height;
+	memset(b->where, 0, sizeof(b->where));
+
+	for (row = 0; row < height; row++) {
+		for (col = 0; col < width; col++) {
+			unsigned int r, c;
+			uint64_t next = 0;
+
+			cube = (row * width) + col;
+			b->letter[cube] = (grid[cube] >= 'a' &&
+				grid[cube] <= 'z') ? grid[cube] - 'a' :
+				GNIGGLE_SOLVE_NOT_LETTER;
+			b->where[b->letter[cube]] |= BIT(cube);
+
+			for (r = (row == 0) ? 0 : row - 1;
+				r <= row + 1 && r < height; r++)
+				for (c = (col == 0) ? 0 : col - 1;
+					c <= col + 1 && c < width; c++)
+					next |= BIT((r * width) + c);
+			b->next[cube] = next & ~BIT(cube);
 		}
-		*o = '-';
 	}
-	
-	free(letters);	
+
 	return true;
 }
 
-#define GRIDOFFSET(ROW, COL) ((ROW * width) + (COL))
-#define GRID(ROW,COL) grid[((ROW) * width) + (COL)]
+/* notes where a cube is in a route, counting from one */
+static void gniggle_solve_note(unsigned int *path, unsigned int cube,
+				unsigned int width)
+{
+	if (path != NULL) {
+		path[0] = (cube % width) + 1;
+		path[1] = (cube / width) + 1;
+	}
+}
+
+/* looks for the rest of a word starting from the cube after 'cube' on a
+ * bitboard
+ */
+static bool gniggle_solve_trace(const struct gniggle_solve_board *b,
+				const char *word, unsigned int cube,
+				uint64_t visited, unsigned int *path)
+{
+	uint64_t m;
 
-static bool gniggle_solve_look(const char *word, char *grid,
-				unsigned int width, unsigned int height,
-				unsigned int x, unsigned int y,
+	gniggle_solve_note(path, cube, b->width);
+
+	if (word[0] == '\0')
+		return true;
+
+	if (word[0] < 'a' || word[0] > 'z')
+		return false;
+
+	visited |= BIT(cube);
+	for (m = b->next[cube] & b->where[word[0] - 'a'] & ~visited; m != 0;
+		m &= m - 1)
+		if (gniggle_solve_trace(b, word + 1, gniggle_solve_lowest(m),
+			visited, path ? path + 2 : NULL) == true)
+			return true;
+
+	return false;
+}
+
+/* as gniggle_solve_trace(), for boards too big for a bitboard */
+static bool gniggle_solve_look(const char *word, const char *grid,
+				bool *used, unsigned int width,
+				unsigned int height, unsigned int cube,
 				unsigned int *path)
 {
-	char eaten;
-	signed int sx, sy;
-	
+	unsigned int row = cube / width, col = cube % width, r, c;
+	bool found = false;
+
+	gniggle_solve_note(path, cube, width);
+
 	if (word[0] == '\0')
 		return true;
 
-	eaten = GRID(x, y);
-	GRID(x, y) = '-';	
-	
-	for (sx = -1; sx < 2; sx++) {
-		for (sy = -1; sy < 2; sy++) {
-			if ( (sx + x >= 0) && (y + sy >= 0) 
-				&& (x + sx < width)
-				&& (y + sy < height)
-			   ) {
-				if (GRID(x + sx, y + sy) == word[0]) {
-					if (path != NULL) {
-						path[0] = y + 1;
-						path[1] = x + 1;
-					}
-					if (gniggle_solve_look(word + 1, grid,
-						width, height,
-						x + sx, y + sy,
-						path ? path + 2 : NULL) ==
-							true) {
-						return true;
-					}
-				}
-			}
-		}
+	used[cube] = true;
+
+	for (r = (row == 0) ? 0 : row - 1;
+		found == false && r <= row + 1 && r < height; r++)
+		for (c = (col == 0) ? 0 : col - 1;
+			found == false && c <= col + 1 && c < width; c++)
+			if (used[(r * width) + c] == false &&
+				grid[(r * width) + c] == word[0])
+				found = gniggle_solve_look(word + 1, grid,
+					used, width, height, (r * width) + c,
+					path ? path + 2 : NULL);
+
+	used[cube] = false;
+
+	return found;
+}
+
+/* looks for a word on a grid, using its bitboard if it has one, or else
+ * 'used', which must have a cleared entry for each cube
+ */
+static bool gniggle_solve_search(const struct gniggle_solve_board *b,
+				bool *used, const char *word,
+				const char *grid,
+				unsigned int width, unsigned int height,
+				unsigned int *path)
+{
+	unsigned int cube;
+	bool found = false;
+	uint64_t m;
+
+	if (b != NULL) {
+		if (word[0] < 'a' || word[0] > 'z')
+			return false;
+		for (m = b->where[word[0] - 'a']; m != 0; m &= m - 1)
+			if (gniggle_solve_trace(b, word + 1,
+				gniggle_solve_lowest(m), 0, path) == true)
+				return true;
+		return false;
 	}
-	
-	GRID(x, y) = eaten;
-	
-	return false;
+
+	for (cube = 0; found == false && cube < width * height; cube++)
+		if (grid[cube] == word[0])
+			found = gniggle_solve_look(word + 1, grid, used,
+					width, height, cube, path);
+
+	return found;
 }
 
 bool gniggle_solve_word_on_grid(const char *word,
@@ -99,58 +245,1772 @@ bool gniggle_solve_word_on_grid(const char *word,
 				const unsigned int height,
 				unsigned int *path)
 {
-	char firstchar = word[0];
-	char *wordc;
-	char *gridc;
-	unsigned int x, y;
+	struct gniggle_solve_board b;
+	bool found;
+	bool *used = NULL;
 	
-	if (gniggle_solve_sufficent_letters(word, grid) == false)
+	if (word[0] == '\0' ||
+		gniggle_solve_sufficent_letters(word, grid) == false)
 		return false;
-		
-	wordc = strdup(word + 1);
-	gridc = strdup(grid);
+
+	if (gniggle_solve_board_init(&b, grid, width, height) == false)
+		used = calloc(sizeof(bool), width * height);
+	
+	found = gniggle_solve_search(used == NULL ? &b : NULL, used, word,
+					grid, width, height, path);
+	
+	free(used);
 	
-	for (x = 0; x < width; x++) {
-		for (y = 0; y < height; y++) {
-			if (GRID(x, y) == firstchar) {
-				if (gniggle_solve_look(wordc, gridc,
-					width, height, x, y, path) == true) {
-					free(wordc);
-					free(gridc);
-					return true;	
+	return found;
+}
+
+/* words are checked against the grid's letters this many at a time */
+#define GNIGGLE_SOLVE_BATCH 64
+
+unsigned int gniggle_solve_signed_words_on_grid(const char **words,
+				const unsigned int *sigs,
+				const unsigned int nwords,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned char *results,
+				unsigned int **paths)
+{
+	struct gniggle_solve_board b;
+	unsigned char fits[GNIGGLE_SOLVE_BATCH];
+	unsigned int count[256];
+	unsigned int letters, i, j, n, r = 0;
+	const unsigned char *p;
+	bool *used = NULL;
+
+	if (gniggle_solve_board_init(&b, grid, width, height) == false)
+		used = calloc(sizeof(bool), width * height);
+
+	letters = gniggle_dictionary_signature(grid);
+	memset(count, 0, sizeof(count));
+	for (p = (const unsigned char *)grid; *p != '\0'; p++)
+		count[*p]++;
+
+	memset(results, 0, nwords / 8 + 1);
+
+	for (i = 0; i < nwords; i += GNIGGLE_SOLVE_BATCH) {
+		n = (nwords - i < GNIGGLE_SOLVE_BATCH) ? nwords - i :
+							GNIGGLE_SOLVE_BATCH;
+
+		/* ruling a batch of words out by their letters touches
+		 * nothing but the signatures, and a whole batch is a fixed
+		 * number of them, which the compiler vectorises
+		 */
+		if (n == GNIGGLE_SOLVE_BATCH)
+			for (j = 0; j < GNIGGLE_SOLVE_BATCH; j++)
+				fits[j] = (sigs[i + j] & ~letters) == 0;
+		else
+			for (j = 0; j < n; j++)
+				fits[j] = (sigs[i + j] & ~letters) == 0;
+
+		for (j = 0; j < n; j++) {
+			const char *word = words[i + j];
+			bool enough = true;
+
+			if (fits[j] == 0 || word[0] == '\0')
+				continue;
+
+			/* take the word's letters from the grid's counts,
+			 * then put them back
+			 */
+			for (p = (const unsigned char *)word; *p != '\0'; p++)
+				if (count[*p]-- == 0) {
+					enough = false;
+					p++;
+					break;
 				}
+			while (p != (const unsigned char *)word)
+				count[*--p]++;
+
+			if (enough == true && gniggle_solve_search(
+				used == NULL ? &b : NULL, used, word, grid,
+				width, height,
+				paths != NULL ? paths[i + j] : NULL) == true) {
+				results[(i + j) >> 3] |= 1 << ((i + j) & 7);
+				r++;
 			}
 		}
 	}
-	
-	free(wordc);
-	free(gridc);
-	
-	return false;
+
+	free(used);
+
+	return r;
 }
 
-#ifdef TEST_RIG
-#include <stdio.h>
-#include <stdlib.h>
+unsigned int gniggle_solve_words_on_grid(const char **words,
+				const unsigned int nwords,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned char *results,
+				unsigned int **paths)
+{
+	unsigned int *sigs = malloc((nwords + 1) * sizeof(unsigned int));
+	unsigned int i, r;
 
-int main(int argc, char *argv[]) {
- 
+	for (i = 0; i < nwords; i++)
+		sigs[i] = gniggle_dictionary_signature(words[i]);
+
+	r = gniggle_solve_signed_words_on_grid(words, sigs, nwords, grid,
+					width, height, results, paths);
+
+	free(sigs);
+
+	return r;
+}
+
+/* Sorted words share a lot of their letters with the word before them.
+ * Rather than look for each from scratch, every route spelling each prefix
+ * of the last word looked for is kept, a level per letter, and the next
+ * word starts from the level for the letters the two have in common.  Each
+ * route is kept as its last cube and the route it came from, along with its
+ * cubes as a mask when the grid has a bitboard.  A level may not grow past
+ * GNIGGLE_SOLVE_FRONTIER routes; past that, the word is looked for on its
+ * own instead, and only the levels before it are kept for the next.
+ */
+#define GNIGGLE_SOLVE_FRONTIER 4096
+
+struct gniggle_solve_step {
+	uint64_t visited;		/* cubes on the route, with a bitboard */
+	uint32_t parent;		/* the route a cube shorter */
+	uint32_t cube;
+};
+
+/* returns true if 'cube' is on the route ending at step 'at', which is
+ * 'depth' cubes after the first
+ */
+static bool gniggle_solve_on_route(const struct gniggle_solve_step *steps,
+				uint32_t at, unsigned int depth,
+				unsigned int cube)
+{
+	for (;; at = steps[at].parent, depth--) {
+		if (steps[at].cube == cube)
+			return true;
+		if (depth == 0)
+			return false;
+	}
+}
+
+/* adds every route that goes on from step 'at', which spells the first
+ * 'have' letters of a word, to a cube showing 'letter'.  There must be room
+ * for eight more steps.  Returns the new number of steps.
+ */
+static unsigned int gniggle_solve_extend(const struct gniggle_solve_board *b,
+				const char *grid,
+				unsigned int width, unsigned int height,
+				struct gniggle_solve_step *steps, uint32_t at,
+				unsigned int have, char letter,
+				unsigned int nsteps)
+{
+	unsigned int j, row, col, cube;
+	uint64_t m;
+
+	if (b != NULL) {
+		if (letter < 'a' || letter > 'z')
+			return nsteps;
+		for (m = b->next[steps[at].cube] & b->where[letter - 'a'] &
+			~steps[at].visited; m != 0; m &= m - 1) {
+			cube = gniggle_solve_lowest(m);
+			steps[nsteps].visited = steps[at].visited | BIT(cube);
+			steps[nsteps].parent = at;
+			steps[nsteps++].cube = cube;
+		}
+		return nsteps;
+	}
+
+	for (j = 0; j < 8; j++) {
+		row = steps[at].cube / width + gniggle_solve_rows[j];
+		col = steps[at].cube % width + gniggle_solve_cols[j];
+		if (row >= height || col >= width)
+			continue;
+		cube = (row * width) + col;
+		if (grid[cube] != letter ||
+			gniggle_solve_on_route(steps, at, have - 1, cube) ==
+				true)
+			continue;
+		steps[nsteps].visited = 0;
+		steps[nsteps].parent = at;
+		steps[nsteps++].cube = cube;
+	}
+
+	return nsteps;
+}
+
+unsigned int gniggle_solve_sorted_words_on_grid(const char **words,
+				const unsigned int nwords,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned char *results,
+				unsigned int **paths)
+{
+	struct gniggle_solve_board b;
+	const struct gniggle_solve_board *board;
+	struct gniggle_solve_step *steps;
+	unsigned int *first = NULL;	/* where each level starts in steps */
+	unsigned int maxfirst = 0, maxsteps = 256, nsteps, have = 0;
+	unsigned int letters, count[256], i, j, k, len, r = 0;
+	const unsigned char *p;
+	const char *last = "";
+	bool *used = NULL;
+
+	board = gniggle_solve_board_init(&b, grid, width, height) ? &b : NULL;
+	letters = gniggle_dictionary_signature(grid);
+	memset(count, 0, sizeof(count));
+	for (p = (const unsigned char *)grid; *p != '\0'; p++)
+		count[*p]++;
+	steps = malloc(maxsteps * sizeof(struct gniggle_solve_step));
+
+	memset(results, 0, nwords / 8 + 1);
+
+	for (i = 0; i < nwords; i++) {
+		const char *word = words[i];
+		bool whole = true, found = true;
+		unsigned int *path = (paths != NULL) ? paths[i] : NULL;
+
+		if (GNIGGLE_SIGNATURE_FITS(gniggle_dictionary_signature(word),
+				letters) == false || word[0] == '\0')
+			continue;
+
+		/* a word with more of a letter than the grid has would fill
+		 * the levels with routes that can never finish it
+		 */
+		for (p = (const unsigned char *)word; *p != '\0'; p++)
+			if (count[*p]-- == 0) {
+				found = false;
+				p++;
+				break;
+			}
+		while (p != (const unsigned char *)word)
+			count[*--p]++;
+		if (found == false)
+			continue;
+
+		len = strlen(word);
+		if (len + 1 > maxfirst) {
+			maxfirst = (len + 1) * 2;
+			first = realloc(first, maxfirst * sizeof(unsigned int));
+			first[0] = 0;
+		}
+
+		/* the levels for the letters this word has in common with
+		 * the last are still good, so carry on from there
+		 */
+		for (j = 0; j < have && j < len && word[j] == last[j]; j++)
+			;
+		have = j;
+		nsteps = first[have];
+		last = word;
+
+		for (; have < len; have++) {
+			unsigned int start = nsteps, most;
+			char letter = word[have];
+
+			/* a route can go on to at most eight cubes */
+			most = (have == 0) ? width * height :
+				(first[have] - first[have - 1]) * 8;
+			if (nsteps + most > maxsteps) {
+				maxsteps = (nsteps + most) * 2;
+				steps = realloc(steps, maxsteps *
+					sizeof(struct gniggle_solve_step));
+			}
+
+			if (have == 0) {
+				for (k = 0; k < width * height; k++) {
+					if (grid[k] != letter)
+						continue;
+					steps[nsteps].visited =
+						(board != NULL) ? BIT(k) : 0;
+					steps[nsteps].parent = 0;
+					steps[nsteps++].cube = k;
+				}
+			} else {
+				for (k = first[have - 1]; k < first[have];
+					k++) {
+					if (nsteps - start >
+						GNIGGLE_SOLVE_FRONTIER) {
+						whole = false;
+						break;
+					}
+					nsteps = gniggle_solve_extend(board,
+						grid, width, height, steps, k,
+						have, letter, nsteps);
+				}
+			}
+
+			if (whole == false)
+				break;
+
+			first[have + 1] = nsteps;
+
+			/* no routes spell this far, so none spell further */
+			if (nsteps == start) {
+				have++;
+				break;
+			}
+		}
+
+		if (whole == true) {
+			found = have == len && first[len] > first[len - 1];
+			if (found == true && path != NULL)
+				for (k = first[len - 1], j = len; j > 0;
+					k = steps[k].parent, j--)
+					gniggle_solve_note(path + (j - 1) * 2,
+						steps[k].cube, width);
+		} else {
+			if (board == NULL && used == NULL)
+				used = calloc(sizeof(bool), width * height);
+			found = gniggle_solve_search(board, used, word, grid,
+						width, height, path);
+		}
+
+		if (found == true) {
+			results[i >> 3] |= 1 << (i & 7);
+			r++;
+		}
+	}
+
+	free(first);
+	free(steps);
+	free(used);
+
+	return r;
+}
+
+/* Boards too big for a bitboard are walked without recursing, keeping a
+ * stack of the cubes on the current route.  A route can be no longer than
+ * the dictionary's longest word, so the stack is never deeper than that,
+ * however big the board.
+ */
+struct gniggle_solve_frame {
+	struct gniggle_dictionary_cursor at;	/* letters spelt so far */
+	unsigned int cube, row, col;
+	unsigned int next;		/* next neighbour to try */
+};
+
+/* state for walking the whole grid.  Words found are recorded by setting the
+ * bit for their rank, which both weeds out words found more than once by
+ * different routes and leaves them in alphabetical order.
+ */
+struct gniggle_solve_walk {
+	struct gniggle_dictionary *dict;
+	const char *grid;
 	unsigned int width, height;
-	unsigned char *grid;
-	unsigned char word[BUFSIZ];
-	
-	width = (unsigned int)atoi(argv[1]);
-	height = (unsigned int)atoi(argv[2]);
-	grid = (unsigned char *)argv[3];
-	
-	while (scanf("%s", word) == 1) {
-		bool found = gniggle_solve_word_on_grid(
-			word, grid, width, height);
-		if (found)
-			printf("%s\n", word);
-			
+	const struct gniggle_solve_board *board;	/* or NULL if too big */
+	uint64_t *visited;		/* a bit for each cube on the route */
+	struct gniggle_solve_frame *stack;	/* the route, as a stack */
+	unsigned int depth;		/* room on the stack */
+	unsigned char *found;		/* a bit for each word in dict */
+	unsigned int nfound;		/* number of words found */
+	uint16_t *route;		/* cubes on the current route, or NULL
+					 * if routes aren't wanted */
+	bool every;			/* keep every route, not just the first */
+	uint32_t *ranks;		/* rank of each route kept */
+	uint16_t *lengths;		/* and its number of cubes */
+	uint16_t *cubes;		/* routes kept, one after another */
+	unsigned int nroutes, ncubes;	/* routes and cubes kept */
+	unsigned int maxroutes, maxcubes;	/* room for them */
+};
+
+/* keeps a copy of the current route, which spells the word of rank 'rank' */
+static void gniggle_solve_keep(struct gniggle_solve_walk *w,
+				unsigned int rank, unsigned int depth)
+{
+	if (w->nroutes == w->maxroutes) {
+		w->maxroutes = (w->maxroutes == 0) ? 64 : w->maxroutes * 2;
+		w->ranks = realloc(w->ranks, w->maxroutes * sizeof(uint32_t));
+		w->lengths = realloc(w->lengths,
+					w->maxroutes * sizeof(uint16_t));
 	}
-	
+	while (w->ncubes + depth + 1 > w->maxcubes) {
+		w->maxcubes = (w->maxcubes == 0) ? 256 : w->maxcubes * 2;
+		w->cubes = realloc(w->cubes, w->maxcubes * sizeof(uint16_t));
+	}
+
+	w->ranks[w->nroutes] = rank;
+	w->lengths[w->nroutes++] = depth + 1;
+	memcpy(w->cubes + w->ncubes, w->route, (depth + 1) * sizeof(uint16_t));
+	w->ncubes += depth + 1;
+}
+
+/* records the word a cursor has spelt, if it is one */
+static void gniggle_solve_found(struct gniggle_solve_walk *w,
+				const struct gniggle_dictionary_cursor *at,
+				unsigned int depth)
+{
+	if (gniggle_dictionary_cursor_word(w->dict, at) == true) {
+		unsigned int rank = gniggle_dictionary_cursor_rank(at);
+		unsigned char bit = 1 << (rank & 7);
+		if ((w->found[rank >> 3] & bit) == 0) {
+			w->found[rank >> 3] |= bit;
+			w->nfound++;
+			if (w->route != NULL)
+				gniggle_solve_keep(w, rank, depth);
+		} else if (w->route != NULL && w->every == true) {
+			gniggle_solve_keep(w, rank, depth);
+		}
+	}
+}
+
+static void gniggle_solve_walk_bits(struct gniggle_solve_walk *w,
+				unsigned int cube, unsigned int depth,
+				uint64_t visited,
+				const struct gniggle_dictionary_cursor *at)
+{
+	struct gniggle_dictionary_cursor next;
+	uint64_t m;
+
+	if (gniggle_dictionary_cursor_step(w->dict, at,
+		'a' + w->board->letter[cube], &next) == false)
+		return;
+
+	if (w->route != NULL)
+		w->route[depth] = cube;
+
+	gniggle_solve_found(w, &next, depth);
+
+	visited |= BIT(cube);
+	for (m = w->board->next[cube] & ~visited; m != 0; m &= m - 1)
+		gniggle_solve_walk_bits(w, gniggle_solve_lowest(m), depth + 1,
+					visited, &next);
+}
+
+static void gniggle_solve_walk_cube(struct gniggle_solve_walk *w,
+				unsigned int cube,
+				const struct gniggle_dictionary_cursor *start)
+{
+	struct gniggle_solve_frame *f = w->stack;
+	unsigned int depth = 0, r, c;
+
+	if (gniggle_dictionary_cursor_step(w->dict, start, w->grid[cube],
+		&f->at) == false)
+		return;
+
+	for (;;) {
+		/* 'f' is a cube just added to the route */
+		f->cube = cube;
+		f->row = cube / w->width;
+		f->col = cube % w->width;
+		f->next = 0;
+		if (w->route != NULL)
+			w->route[depth] = cube;
+		gniggle_solve_found(w, &f->at, depth);
+		w->visited[cube / 64] |= BIT(cube % 64);
+
+		/* find the next neighbour that spells more of a word, backing
+		 * up along the route when a cube has none left
+		 */
+		for (;;) {
+			if (f->next == 8) {
+				w->visited[f->cube / 64] &= ~BIT(f->cube % 64);
+				if (depth == 0)
+					return;
+				depth--;
+				f--;
+				continue;
+			}
+
+			r = f->row + gniggle_solve_rows[f->next];
+			c = f->col + gniggle_solve_cols[f->next];
+			f->next++;
+			if (r >= w->height || c >= w->width)
+				continue;
+
+			cube = (r * w->width) + c;
+			if ((w->visited[cube / 64] & BIT(cube % 64)) != 0 ||
+				depth + 1 == w->depth)
+				continue;
+
+			if (gniggle_dictionary_cursor_step(w->dict, &f->at,
+				w->grid[cube], &(f + 1)->at) == true)
+				break;
+		}
+
+		depth++;
+		f++;
+	}
+}
+
+static void gniggle_solve_walk_init(struct gniggle_solve_walk *w,
+				struct gniggle_dictionary *dict,
+				const char *grid,
+				unsigned int width, unsigned int height,
+				const struct gniggle_solve_board *board)
+{
+	w->dict = dict;
+	w->grid = grid;
+	w->width = width;
+	w->height = height;
+	w->board = board;
+	w->visited = NULL;
+	w->stack = NULL;
+	w->depth = 0;
+	if (board == NULL) {
+		w->visited = calloc(sizeof(uint64_t), (width * height) / 64 + 1);
+		w->depth = gniggle_dictionary_maxlen(dict) + 1;
+		w->stack = malloc(w->depth * sizeof(struct gniggle_solve_frame));
+	}
+	w->found = calloc(1, gniggle_dictionary_size(dict) / 8 + 1);
+	w->nfound = 0;
+	w->route = NULL;
+	w->every = false;
+	w->ranks = NULL;
+	w->lengths = NULL;
+	w->cubes = NULL;
+	w->nroutes = w->ncubes = 0;
+	w->maxroutes = w->maxcubes = 0;
+}
+
+/* finds every word whose route starts at 'cube' */
+static void gniggle_solve_walk_from(struct gniggle_solve_walk *w,
+				unsigned int cube,
+				const struct gniggle_dictionary_cursor *start)
+{
+	if (w->board != NULL)
+		gniggle_solve_walk_bits(w, cube, 0, 0, start);
+	else
+		gniggle_solve_walk_cube(w, cube, start);
+}
+
+/* frees what a walk allocated, other than routes */
+static void gniggle_solve_walk_free(struct gniggle_solve_walk *w)
+{
+	free(w->visited);
+	free(w->stack);
+	free(w->found);
+}
+
+/* writes the ranks of a walk's found words into 'r', which must have room
+ * for all of them, and returns how many there are.  If 'clear' is true, the
+ * walk is left ready to find words on another grid.
+ */
+static unsigned int gniggle_solve_walk_gather(struct gniggle_solve_walk *w,
+				uint32_t *r, bool clear)
+{
+	unsigned int rank, n;
+
+	for (rank = 0, n = 0; n < w->nfound; rank++) {
+		if (w->found[rank >> 3] == 0) {
+			rank |= 7;
+			continue;
+		}
+		if ((w->found[rank >> 3] & (1 << (rank & 7))) != 0)
+			r[n++] = rank;
+		if (clear == true && (rank & 7) == 7)
+			w->found[rank >> 3] = 0;
+	}
+
+	if (clear == true) {
+		if (n != 0)
+			w->found[(rank - 1) >> 3] = 0;
+		w->nfound = 0;
+	}
+
+	return n;
+}
+
+/* turns a walk's found words into an array of their ranks, and frees it */
+static uint32_t *gniggle_solve_walk_finish(struct gniggle_solve_walk *w,
+				unsigned int *count)
+{
+	uint32_t *r = malloc((w->nfound + 1) * sizeof(uint32_t));
+
+	*count = gniggle_solve_walk_gather(w, r, false);
+
+	gniggle_solve_walk_free(w);
+
+	return r;
+}
+
+uint32_t *gniggle_solve_grid_ids(struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned int *count)
+{
+	struct gniggle_solve_walk w;
+	struct gniggle_solve_board b;
+	struct gniggle_dictionary_cursor start;
+	unsigned int cube;
+
+	gniggle_dictionary_cursor_init(dict, &start);
+	gniggle_solve_walk_init(&w, dict, grid, width, height,
+		gniggle_solve_board_init(&b, grid, width, height) ? &b : NULL);
+
+	for (cube = 0; cube < width * height; cube++)
+		gniggle_solve_walk_from(&w, cube, &start);
+
+	return gniggle_solve_walk_finish(&w, count);
+}
+
+struct gniggle_solve_scratch {
+	struct gniggle_solve_walk w;
+	struct gniggle_solve_board b;
+	struct gniggle_dictionary_cursor start;
+	uint32_t *ids;			/* words found on the last grid */
+	unsigned int maxids;		/* room in ids */
+};
+
+struct gniggle_solve_scratch *gniggle_solve_scratch_new(
+				struct gniggle_dictionary *dict,
+				const unsigned int width,
+				const unsigned int height)
+{
+	struct gniggle_solve_scratch *r =
+		calloc(sizeof(struct gniggle_solve_scratch), 1);
+
+	r->maxids = 64;
+	r->ids = malloc(r->maxids * sizeof(uint32_t));
+	gniggle_dictionary_cursor_init(dict, &r->start);
+	gniggle_solve_walk_init(&r->w, dict, NULL, width, height,
+		(width * height <= GNIGGLE_SOLVE_BITS) ? &r->b : NULL);
+
+	return r;
+}
+
+unsigned int gniggle_solve_grid_scratch(struct gniggle_solve_scratch *scratch,
+				const char *grid,
+				const uint32_t **ids)
+{
+	struct gniggle_solve_walk *w = &scratch->w;
+	unsigned int cube;
+
+	w->grid = grid;
+	if (w->board != NULL)
+		gniggle_solve_board_init(&scratch->b, grid, w->width,
+						w->height);
+
+	for (cube = 0; cube < w->width * w->height; cube++)
+		gniggle_solve_walk_from(w, cube, &scratch->start);
+
+	if (w->nfound > scratch->maxids) {
+		scratch->maxids = w->nfound * 2;
+		scratch->ids = realloc(scratch->ids,
+				scratch->maxids * sizeof(uint32_t));
+	}
+
+	*ids = scratch->ids;
+	return gniggle_solve_walk_gather(w, scratch->ids, true);
+}
+
+void gniggle_solve_scratch_delete(struct gniggle_solve_scratch *scratch)
+{
+	gniggle_solve_walk_free(&scratch->w);
+	free(scratch->ids);
+	free(scratch);
+}
+
+/* finds where a rank is in an ascending array of them */
+static unsigned int gniggle_solve_index(const uint32_t *ids, unsigned int n,
+				uint32_t rank)
+{
+	unsigned int lo = 0, hi = n, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (ids[mid] < rank)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+struct gniggle_solve_routes *gniggle_solve_grid_routes(
+				struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				bool every)
+{
+	struct gniggle_solve_routes *r;
+	struct gniggle_solve_walk w;
+	struct gniggle_solve_board b;
+	struct gniggle_dictionary_cursor start;
+	unsigned int cube, i, n, *fill;
+	uint16_t *from;
+
+	if (width * height > GNIGGLE_SOLVE_MAX_CUBES)
+		return NULL;
+
+	gniggle_dictionary_cursor_init(dict, &start);
+	gniggle_solve_walk_init(&w, dict, grid, width, height,
+		gniggle_solve_board_init(&b, grid, width, height) ? &b : NULL);
+	w.route = malloc(width * height * sizeof(uint16_t));
+	w.every = every;
+
+	for (cube = 0; cube < width * height; cube++)
+		gniggle_solve_walk_from(&w, cube, &start);
+
+	r = calloc(sizeof(struct gniggle_solve_routes), 1);
+	r->ids = gniggle_solve_walk_finish(&w, &r->count);
+	n = r->count;
+	r->length = calloc(sizeof(unsigned int), n + 1);
+	r->routes = calloc(sizeof(unsigned int), n + 1);
+	r->start = calloc(sizeof(unsigned int), n + 1);
+	r->cubes = malloc((w.ncubes + 1) * sizeof(uint16_t));
+	fill = malloc((n + 1) * sizeof(unsigned int));
+
+	/* the routes were kept in the order they were found, so count them
+	 * by word to see where each word's go, then copy them there
+	 */
+	for (i = 0; i < w.nroutes; i++) {
+		w.ranks[i] = gniggle_solve_index(r->ids, n, w.ranks[i]);
+		r->routes[w.ranks[i]]++;
+		r->length[w.ranks[i]] = w.lengths[i];
+	}
+
+	for (i = 0; i < n; i++)
+		fill[i + 1] = r->start[i + 1] = r->start[i] +
+						r->routes[i] * r->length[i];
+	fill[0] = 0;
+
+	for (i = 0, from = w.cubes; i < w.nroutes; i++) {
+		memcpy(r->cubes + fill[w.ranks[i]], from,
+			w.lengths[i] * sizeof(uint16_t));
+		fill[w.ranks[i]] += w.lengths[i];
+		from += w.lengths[i];
+	}
+
+	free(fill);
+	free(w.route);
+	free(w.ranks);
+	free(w.lengths);
+	free(w.cubes);
+
+	return r;
+}
+
+void gniggle_solve_routes_delete(struct gniggle_solve_routes *routes)
+{
+	free(routes->ids);
+	free(routes->length);
+	free(routes->routes);
+	free(routes->start);
+	free(routes->cubes);
+	free(routes);
+}
+
+/* Threads share out the starting cubes, each taking the next one not yet
+ * taken when it finishes the last, as some cubes lead to far more words than
+ * others.  Each keeps its own record of the words it found, and these are
+ * merged at the end.
+ */
+struct gniggle_solve_share {
+	pthread_mutex_t lock;		/* held to take a cube */
+	unsigned int next;		/* next cube to take */
+	unsigned int cubes;		/* number of cubes */
+	const struct gniggle_dictionary_cursor *start;
+};
+
+struct gniggle_solve_worker {
+	struct gniggle_solve_walk w;
+	struct gniggle_solve_share *share;
+	pthread_t thread;
+	bool threaded;			/* thread needs joining */
+};
+
+static void *gniggle_solve_work(void *p)
+{
+	struct gniggle_solve_worker *worker = p;
+	struct gniggle_solve_share *share = worker->share;
+	unsigned int cube;
+
+	for (;;) {
+		pthread_mutex_lock(&share->lock);
+		cube = share->next++;
+		pthread_mutex_unlock(&share->lock);
+
+		if (cube >= share->cubes)
+			break;
+
+		gniggle_solve_walk_from(&worker->w, cube, share->start);
+	}
+
+	return NULL;
+}
+
+uint32_t *gniggle_solve_grid_ids_threaded(struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned int threads,
+				unsigned int *count)
+{
+	struct gniggle_solve_worker *workers;
+	struct gniggle_solve_share share;
+	struct gniggle_solve_board b;
+	struct gniggle_dictionary_cursor start;
+	const struct gniggle_solve_board *board;
+	unsigned int i, j, bytes;
+	uint32_t *r;
+
+	if (threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (cpus < 1) ? 1 : cpus;
+	}
+	if (threads > width * height)
+		threads = width * height;
+	if (threads <= 1)
+		return gniggle_solve_grid_ids(dict, grid, width, height, count);
+
+	/* everything the dictionary builds when first needed is built now,
+	 * so the threads only read it
+	 */
+	gniggle_dictionary_cursor_init(dict, &start);
+	board = gniggle_solve_board_init(&b, grid, width, height) ? &b : NULL;
+
+	pthread_mutex_init(&share.lock, NULL);
+	share.next = 0;
+	share.cubes = width * height;
+	share.start = &start;
+
+	workers = calloc(sizeof(struct gniggle_solve_worker), threads);
+	for (i = 0; i < threads; i++) {
+		gniggle_solve_walk_init(&workers[i].w, dict, grid, width,
+					height, board);
+		workers[i].share = &share;
+	}
+
+	for (i = 1; i < threads; i++) {
+		workers[i].threaded = pthread_create(&workers[i].thread, NULL,
+				gniggle_solve_work, &workers[i]) == 0;
+	}
+	gniggle_solve_work(&workers[0]);
+	for (i = 1; i < threads; i++)
+		if (workers[i].threaded == true)
+			pthread_join(workers[i].thread, NULL);
+
+	/* any thread that couldn't be started left its share to the others,
+	 * so merging is just a matter of combining what each found
+	 */
+	bytes = gniggle_dictionary_size(dict) / 8 + 1;
+	for (i = 1; i < threads; i++) {
+		for (j = 0; j < bytes; j++)
+			workers[0].w.found[j] |= workers[i].w.found[j];
+		gniggle_solve_walk_free(&workers[i].w);
+	}
+
+	workers[0].w.nfound = 0;
+	for (j = 0; j < bytes; j++) {
+		unsigned char byte = workers[0].w.found[j];
+		for (; byte != 0; byte &= byte - 1)
+			workers[0].w.nfound++;
+	}
+
+	r = gniggle_solve_walk_finish(&workers[0].w, count);
+
+	free(workers);
+	pthread_mutex_destroy(&share.lock);
+
+	return r;
+}
+
+const char **gniggle_solve_grid(struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height)
+{
+	unsigned int n;
+	uint32_t *ids = gniggle_solve_grid_ids(dict, grid, width, height, &n);
+	const char **r = gniggle_dictionary_words(dict, ids, n);
+
+	free(ids);
+
+	return r;
+}
+
+const char **gniggle_solve_grid_threaded(struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned int threads)
+{
+	unsigned int n;
+	uint32_t *ids = gniggle_solve_grid_ids_threaded(dict, grid, width,
+						height, threads, &n);
+	const char **r = gniggle_dictionary_words(dict, ids, n);
+
+	free(ids);
+
+	return r;
+}
+
+/* The walk of a grid can be kept as a tree, so that when cubes change it
+ * can be brought up to date without walking the whole grid again.  Each node
+ * is a cube on a route spelling the start of a word, and its children are
+ * the cubes the route goes on to.  Every node is also on a list of the nodes
+ * at its cube, so when a cube changes, the routes through it can be cut off
+ * and grown again from the cubes around it with the new letter.  A word is
+ * found as long as at least one route spells it.
+ */
+#define GNIGGLE_SOLVE_NO_NODE 0xffffffffu
+
+struct gniggle_solve_node {
+	struct gniggle_dictionary_cursor at;	/* letters spelt so far */
+	uint32_t cube;
+	uint32_t parent;		/* or GNIGGLE_SOLVE_NO_NODE */
+	uint32_t child;			/* first child */
+	uint32_t sibling;		/* next child of the same parent, or
+					 * next free node */
+	uint32_t prev, next;		/* other nodes at the same cube */
+};
+
+/* a node being grown from, and the next of its neighbours to try */
+struct gniggle_solve_growth {
+	uint32_t node;
+	unsigned int row, col;
+	unsigned int next;
+};
+
+struct gniggle_solve_state {
+	struct gniggle_dictionary *dict;
+	struct gniggle_dictionary_cursor start;
+	char *grid;
+	unsigned int width, height;
+	struct gniggle_solve_node *nodes;
+	unsigned int nnodes, maxnodes;	/* nodes used, and room for them */
+	uint32_t free;			/* first free node */
+	uint32_t *first;		/* first node at each cube */
+	uint32_t *routes;		/* routes spelling each word, by rank */
+	unsigned int nfound;		/* words with at least one route */
+	uint64_t *visited;		/* cubes on the route being grown */
+	struct gniggle_solve_growth *stack;
+	unsigned int depth;		/* room on the stack */
+	uint32_t *pending;		/* nodes to grow from, and into where */
+	unsigned int maxpending;
+};
+
+/* adds a node, spelling what 'at' has, as the last child of 'parent' */
+static uint32_t gniggle_solve_state_add(struct gniggle_solve_state *s,
+				uint32_t parent, unsigned int cube,
+				const struct gniggle_dictionary_cursor *at)
+{
+	struct gniggle_solve_node *node;
+	uint32_t n;
+
+	if (s->free != GNIGGLE_SOLVE_NO_NODE) {
+		n = s->free;
+		s->free = s->nodes[n].sibling;
+	} else {
+		if (s->nnodes == s->maxnodes) {
+			s->maxnodes = (s->maxnodes == 0) ? 1024 :
+						s->maxnodes * 2;
+			s->nodes = realloc(s->nodes, s->maxnodes *
+					sizeof(struct gniggle_solve_node));
+		}
+		n = s->nnodes++;
+	}
+
+	node = s->nodes + n;
+	node->at = *at;
+	node->cube = cube;
+	node->parent = parent;
+	node->child = GNIGGLE_SOLVE_NO_NODE;
+	node->sibling = GNIGGLE_SOLVE_NO_NODE;
+	if (parent != GNIGGLE_SOLVE_NO_NODE) {
+		node->sibling = s->nodes[parent].child;
+		s->nodes[parent].child = n;
+	}
+
+	node->prev = GNIGGLE_SOLVE_NO_NODE;
+	node->next = s->first[cube];
+	if (node->next != GNIGGLE_SOLVE_NO_NODE)
+		s->nodes[node->next].prev = n;
+	s->first[cube] = n;
+
+	if (gniggle_dictionary_cursor_word(s->dict, at) == true &&
+		s->routes[gniggle_dictionary_cursor_rank(at)]++ == 0)
+		s->nfound++;
+
+	return n;
+}
+
+/* frees a node, which has no children left and has already been taken off
+ * its parent's list
+ */
+static void gniggle_solve_state_drop(struct gniggle_solve_state *s,
+				uint32_t n)
+{
+	struct gniggle_solve_node *node = s->nodes + n;
+
+	if (node->prev != GNIGGLE_SOLVE_NO_NODE)
+		s->nodes[node->prev].next = node->next;
+	else
+		s->first[node->cube] = node->next;
+	if (node->next != GNIGGLE_SOLVE_NO_NODE)
+		s->nodes[node->next].prev = node->prev;
+
+	if (gniggle_dictionary_cursor_word(s->dict, &node->at) == true &&
+		--s->routes[gniggle_dictionary_cursor_rank(&node->at)] == 0)
+		s->nfound--;
+
+	node->sibling = s->free;
+	s->free = n;
+}
+
+/* removes a node and every route that goes on from it */
+static void gniggle_solve_state_cut(struct gniggle_solve_state *s,
+				uint32_t x)
+{
+	uint32_t n = x, p = s->nodes[x].parent;
+
+	if (p != GNIGGLE_SOLVE_NO_NODE) {
+		if (s->nodes[p].child == x) {
+			s->nodes[p].child = s->nodes[x].sibling;
+		} else {
+			for (p = s->nodes[p].child; s->nodes[p].sibling != x;
+				p = s->nodes[p].sibling)
+				;
+			s->nodes[p].sibling = s->nodes[x].sibling;
+		}
+	}
+
+	/* free the nodes below 'x' from the bottom up, always going down
+	 * to the first child, so each freed node is the first of its
+	 * parent's children
+	 */
+	for (;;) {
+		while (s->nodes[n].child != GNIGGLE_SOLVE_NO_NODE)
+			n = s->nodes[n].child;
+		p = s->nodes[n].parent;
+		if (n != x)
+			s->nodes[p].child = s->nodes[n].sibling;
+		gniggle_solve_state_drop(s, n);
+		if (n == x)
+			break;
+		n = p;
+	}
+}
+
+/* adds every route that goes from the node 'from' on to 'cube', or starts
+ * at 'cube' if 'from' is GNIGGLE_SOLVE_NO_NODE
+ */
+static void gniggle_solve_state_grow(struct gniggle_solve_state *s,
+				uint32_t from, unsigned int cube)
+{
+	struct gniggle_dictionary_cursor next;
+	struct gniggle_solve_growth *f = s->stack;
+	unsigned int depth = 0, r, c;
+	uint32_t n;
+
+	if (gniggle_dictionary_cursor_step(s->dict,
+		(from == GNIGGLE_SOLVE_NO_NODE) ? &s->start :
+			&s->nodes[from].at, s->grid[cube], &next) == false)
+		return;
+
+	for (n = from; n != GNIGGLE_SOLVE_NO_NODE; n = s->nodes[n].parent)
+		s->visited[s->nodes[n].cube / 64] |= BIT(s->nodes[n].cube % 64);
+
+	n = gniggle_solve_state_add(s, from, cube, &next);
+
+	for (;;) {
+		/* 'n' is a node just added at 'cube' */
+		f->node = n;
+		f->row = cube / s->width;
+		f->col = cube % s->width;
+		f->next = 0;
+		s->visited[cube / 64] |= BIT(cube % 64);
+
+		for (;;) {
+			if (f->next == 8) {
+				cube = s->nodes[f->node].cube;
+				s->visited[cube / 64] &= ~BIT(cube % 64);
+				if (depth == 0) {
+					f = NULL;
+					break;
+				}
+				depth--;
+				f--;
+				continue;
+			}
+
+			r = f->row + gniggle_solve_rows[f->next];
+			c = f->col + gniggle_solve_cols[f->next];
+			f->next++;
+			if (r >= s->height || c >= s->width)
+				continue;
+
+			cube = (r * s->width) + c;
+			if ((s->visited[cube / 64] & BIT(cube % 64)) != 0 ||
+				depth + 1 == s->depth)
+				continue;
+
+			if (gniggle_dictionary_cursor_step(s->dict,
+				&s->nodes[f->node].at, s->grid[cube], &next)
+				== true)
+				break;
+		}
+
+		if (f == NULL)
+			break;
+
+		n = gniggle_solve_state_add(s, f->node, cube, &next);
+		depth++;
+		f++;
+	}
+
+	for (n = from; n != GNIGGLE_SOLVE_NO_NODE; n = s->nodes[n].parent)
+		s->visited[s->nodes[n].cube / 64] &= ~BIT(s->nodes[n].cube % 64);
+}
+
+struct gniggle_solve_state *gniggle_solve_state_new(
+				struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height)
+{
+	struct gniggle_solve_state *r =
+		calloc(sizeof(struct gniggle_solve_state), 1);
+	unsigned int cube;
+
+	r->dict = dict;
+	gniggle_dictionary_cursor_init(dict, &r->start);
+	r->grid = strdup(grid);
+	r->width = width;
+	r->height = height;
+	r->free = GNIGGLE_SOLVE_NO_NODE;
+	r->first = malloc((width * height + 1) * sizeof(uint32_t));
+	for (cube = 0; cube < width * height; cube++)
+		r->first[cube] = GNIGGLE_SOLVE_NO_NODE;
+	r->routes = calloc(sizeof(uint32_t), gniggle_dictionary_size(dict) + 1);
+	r->visited = calloc(sizeof(uint64_t), (width * height) / 64 + 1);
+	r->depth = gniggle_dictionary_maxlen(dict) + 1;
+	r->stack = malloc(r->depth * sizeof(struct gniggle_solve_growth));
+
+	for (cube = 0; cube < width * height; cube++)
+		gniggle_solve_state_grow(r, GNIGGLE_SOLVE_NO_NODE, cube);
+
+	return r;
+}
+
+unsigned int gniggle_solve_state_change(struct gniggle_solve_state *state,
+				const unsigned int *cubes,
+				const char *letters,
+				unsigned int n)
+{
+	struct gniggle_solve_state *s = state;
+	unsigned int *changed = malloc((n + 1) * sizeof(unsigned int));
+	unsigned int nchanged = 0, npending = 0, i, k, r, c, cube;
+	uint32_t m;
+
+	/* the visited set is empty between calls, so it can mark which cubes
+	 * have changed for now
+	 */
+	for (i = 0; i < n; i++) {
+		cube = cubes[i];
+		if (cube >= s->width * s->height || s->grid[cube] == letters[i])
+			continue;
+		s->grid[cube] = letters[i];
+		if ((s->visited[cube / 64] & BIT(cube % 64)) == 0) {
+			s->visited[cube / 64] |= BIT(cube % 64);
+			changed[nchanged++] = cube;
+		}
+	}
+
+	for (i = 0; i < nchanged; i++) {
+		s->visited[changed[i] / 64] &= ~BIT(changed[i] % 64);
+		while (s->first[changed[i]] != GNIGGLE_SOLVE_NO_NODE)
+			gniggle_solve_state_cut(s, s->first[changed[i]]);
+	}
+
+	/* what's left are the routes that didn't touch a changed cube.  Any
+	 * route that does can only start at one, or go into one from the
+	 * end of one of these, so note where to grow from before growing
+	 * anything
+	 */
+	for (i = 0; i < nchanged; i++) {
+		for (k = 0; k < 8; k++) {
+			r = changed[i] / s->width + gniggle_solve_rows[k];
+			c = changed[i] % s->width + gniggle_solve_cols[k];
+			if (r >= s->height || c >= s->width)
+				continue;
+			for (m = s->first[(r * s->width) + c];
+				m != GNIGGLE_SOLVE_NO_NODE;
+				m = s->nodes[m].next) {
+				if (npending + 2 > s->maxpending) {
+					s->maxpending = (npending + 2) * 2;
+					s->pending = realloc(s->pending,
+						s->maxpending *
+							sizeof(uint32_t));
+				}
+				s->pending[npending++] = m;
+				s->pending[npending++] = changed[i];
+			}
+		}
+	}
+
+	for (i = 0; i < nchanged; i++)
+		gniggle_solve_state_grow(s, GNIGGLE_SOLVE_NO_NODE, changed[i]);
+	for (i = 0; i < npending; i += 2)
+		gniggle_solve_state_grow(s, s->pending[i], s->pending[i + 1]);
+
+	free(changed);
+
+	return s->nfound;
+}
+
+unsigned int gniggle_solve_state_count(struct gniggle_solve_state *state)
+{
+	return state->nfound;
+}
+
+bool gniggle_solve_state_found(struct gniggle_solve_state *state,
+				uint32_t id)
+{
+	return id < gniggle_dictionary_size(state->dict) &&
+		state->routes[id] != 0;
+}
+
+uint32_t *gniggle_solve_state_ids(struct gniggle_solve_state *state,
+				unsigned int *count)
+{
+	uint32_t *r = malloc((state->nfound + 1) * sizeof(uint32_t));
+	unsigned int rank, n;
+
+	for (rank = 0, n = 0; n < state->nfound; rank++)
+		if (state->routes[rank] != 0)
+			r[n++] = rank;
+
+	*count = n;
+	return r;
+}
+
+const char *gniggle_solve_state_grid(struct gniggle_solve_state *state)
+{
+	return state->grid;
+}
+
+size_t gniggle_solve_state_memory(struct gniggle_solve_state *state)
+{
+	unsigned int cubes = state->width * state->height;
+
+	return sizeof(struct gniggle_solve_state) + cubes + 1 +
+		state->maxnodes * sizeof(struct gniggle_solve_node) +
+		(cubes + 1) * sizeof(uint32_t) +
+		(gniggle_dictionary_size(state->dict) + 1) * sizeof(uint32_t) +
+		(cubes / 64 + 1) * sizeof(uint64_t) +
+		state->depth * sizeof(struct gniggle_solve_growth) +
+		state->maxpending * sizeof(uint32_t);
+}
+
+void gniggle_solve_state_delete(struct gniggle_solve_state *state)
+{
+	free(state->grid);
+	free(state->nodes);
+	free(state->first);
+	free(state->routes);
+	free(state->visited);
+	free(state->stack);
+	free(state->pending);
+	free(state);
+}
+
+#ifdef TEST_RIG
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Build with:
+ *	cc -DTEST_RIG -D_GNU_SOURCE -o solve-test solve.c libgniggle.a -lz -lpthread
+ *
+ * "solve-test width height grid < words" prints each word on the grid with
+ * its route.  "solve-test < words" instead checks the solver against
+ * itself on random boards of several shapes, using the words as the
+ * dictionary, and exits non-zero if anything disagrees.  Solve states are
+ * checked by changing cubes at random and solving the grid afresh, and
+ * lists of words, sorted and shuffled, by looking for them both ways.
+ */
+
+/* the board shapes checked, including ones too big for a bitboard */
+static const unsigned int gniggle_solve_shapes[][2] = {
+	{ 4, 4 }, { 5, 3 }, { 3, 5 }, { 1, 9 }, { 9, 1 }, { 8, 8 },
+	{ 9, 8 }, { 11, 7 }, { 2, 40 }, { 0, 0 }
+};
+
+static char *gniggle_solve_random(unsigned int width, unsigned int height)
+{
+	static const char letters[] = "aaaaaabbcceeeeeeeeeeiiiiooooouull"
+					"lnnnrrrsssstttddmpgq";
+	char *r = malloc(width * height + 1);
+	unsigned int i;
+
+	for (i = 0; i < width * height; i++)
+		r[i] = letters[rand() % (sizeof(letters) - 1)];
+	r[i] = '\0';
+
+	return r;
+}
+
+/* returns true if 'path' is a route spelling 'word' on the grid */
+static bool gniggle_solve_route_ok(const char *word, const char *grid,
+				unsigned int width, unsigned int height,
+				const unsigned int *path)
+{
+	unsigned int i, j, n = strlen(word);
+
+	for (i = 0; i < n; i++) {
+		unsigned int x = path[i * 2], y = path[i * 2 + 1];
+
+		if (x < 1 || x > width || y < 1 || y > height ||
+			grid[(y - 1) * width + (x - 1)] != word[i])
+			return false;
+		if (i > 0 && (x + 1 < path[i * 2 - 2] ||
+			x > path[i * 2 - 2] + 1 ||
+			y + 1 < path[i * 2 - 1] || y > path[i * 2 - 1] + 1))
+			return false;
+		for (j = 0; j < i; j++)
+			if (path[j * 2] == x && path[j * 2 + 1] == y)
+				return false;
+	}
+
+	return true;
+}
+
+/* checks that each word in the dictionary is found by looking for it on
+ * its own exactly when solving the whole grid finds it, and that the route
+ * given for it is right
+ */
+static unsigned int gniggle_solve_check_words(struct gniggle_dictionary *dict,
+				const char *grid,
+				unsigned int width, unsigned int height)
+{
+	unsigned int *path = malloc((gniggle_dictionary_maxlen(dict) + 1) * 2 *
+					sizeof(unsigned int));
+	char *buffer = malloc(gniggle_dictionary_maxlen(dict) + 1);
+	unsigned int i, n, a = 0, bad = 0;
+	uint32_t *ids = gniggle_solve_grid_ids(dict, grid, width, height, &n);
+
+	for (i = 0; i < gniggle_dictionary_size(dict); i++) {
+		const char *word = gniggle_dictionary_word(dict, i, buffer);
+		bool on = gniggle_solve_word_on_grid(word, grid, width, height,
+							path);
+
+		if (on != (a < n && ids[a] == i)) {
+			printf("%ux%u %s: %s solving alone\n", width, height,
+				word, on ? "only found" : "not found");
+			bad++;
+		}
+		if (on == true && gniggle_solve_route_ok(word, grid, width,
+				height, path) == false) {
+			printf("%ux%u %s: bad route\n", width, height, word);
+			bad++;
+		}
+		if (a < n && ids[a] == i)
+			a++;
+	}
+
+	free(ids);
+	free(buffer);
+	free(path);
+
+	return bad;
+}
+
+/* checks many words against one grid both at once and sharing prefixes,
+ * comparing the answers and the routes given.  Returns the number of
+ * differences.
+ */
+static unsigned int gniggle_solve_check_list(const char **words,
+				unsigned int nwords, unsigned int maxlen,
+				const char *grid,
+				unsigned int width, unsigned int height)
+{
+	unsigned char *plain = malloc(nwords / 8 + 1);
+	unsigned char *sorted = malloc(nwords / 8 + 1);
+	unsigned int **paths = malloc(nwords * sizeof(unsigned int *));
+	unsigned int *room = malloc(nwords * (maxlen + 1) * 2 *
+					sizeof(unsigned int));
+	unsigned int i, n, m, bad = 0;
+
+	for (i = 0; i < nwords; i++)
+		paths[i] = room + i * (maxlen + 1) * 2;
+
+	n = gniggle_solve_words_on_grid(words, nwords, grid, width, height,
+						plain, paths);
+	for (i = 0; i < nwords; i++)
+		if ((plain[i / 8] & (1 << (i % 8))) != 0 &&
+			gniggle_solve_route_ok(words[i], grid, width, height,
+						paths[i]) == false) {
+			printf("%ux%u %s: bad route\n", width, height,
+				words[i]);
+			bad++;
+		}
+
+	m = gniggle_solve_sorted_words_on_grid(words, nwords, grid, width,
+						height, sorted, paths);
+	for (i = 0; i < nwords; i++) {
+		bool on = (sorted[i / 8] & (1 << (i % 8))) != 0;
+
+		if (on != ((plain[i / 8] & (1 << (i % 8))) != 0)) {
+			printf("%ux%u %s: %s sharing prefixes\n", width,
+				height, words[i], on ? "only found" :
+							"not found");
+			bad++;
+		} else if (on == true && gniggle_solve_route_ok(words[i],
+				grid, width, height, paths[i]) == false) {
+			printf("%ux%u %s: bad route sharing prefixes\n",
+				width, height, words[i]);
+			bad++;
+		}
+	}
+	if (n != m)
+		bad++;
+
+	free(room);
+	free(paths);
+	free(sorted);
+	free(plain);
+
+	return bad;
+}
+
+/* checks a list of words in the dictionary's order, and then shuffled */
+static unsigned int gniggle_solve_check_lists(struct gniggle_dictionary *dict,
+				const char *grid,
+				unsigned int width, unsigned int height)
+{
+	unsigned int i, j, n = gniggle_dictionary_size(dict), bad;
+	unsigned int maxlen = gniggle_dictionary_maxlen(dict);
+	const char **words = malloc(n * sizeof(char *));
+	char *text = malloc(n * (maxlen + 1)), *t;
+
+	for (i = 0; i < n; i++) {
+		t = text + i * (maxlen + 1);
+		words[i] = gniggle_dictionary_word(dict, i, t);
+	}
+
+	bad = gniggle_solve_check_list(words, n, maxlen, grid, width, height);
+
+	for (i = n; i > 1; i--) {
+		const char *swap = words[i - 1];
+
+		j = rand() % i;
+		words[i - 1] = words[j];
+		words[j] = swap;
+	}
+
+	bad += gniggle_solve_check_list(words, n, maxlen, grid, width, height);
+
+	free(text);
+	free(words);
+
+	return bad;
+}
+
+/* a grid of one letter has so many routes for each word that sharing
+ * prefixes has to fall back to looking for words on their own
+ */
+static unsigned int gniggle_solve_check_frontier(void)
+{
+	static const char *words[] = {
+		"eee", "eeee", "eeeee", "eeeeee", "eeeeeee", "eeeeeeee",
+		"eeeeeeeee", "eeeeeeeeee", "eeeeeeeeeee", "eeeeeeeeeeee",
+		"eeez"
+	};
+	unsigned char results[2];
+	unsigned int i, n, bad = 0;
+	unsigned int room[11][26 * 2], *paths[11];
+
+	for (i = 0; i < 11; i++)
+		paths[i] = room[i];
+
+	n = gniggle_solve_sorted_words_on_grid(words, 11,
+		"eeeeeeeeeeeeeeeeeeeeeeeee", 5, 5, results, paths);
+	for (i = 0; i < 10; i++)
+		if ((results[i / 8] & (1 << (i % 8))) == 0 ||
+			gniggle_solve_route_ok(words[i],
+				"eeeeeeeeeeeeeeeeeeeeeeeee", 5, 5,
+				paths[i]) == false) {
+			printf("5x5 %s: not found past the frontier\n",
+				words[i]);
+			bad++;
+		}
+	if (n != 10 || (results[10 / 8] & (1 << (10 % 8))) != 0)
+		bad++;
+
+	return bad;
+}
+
+/* makes random changes of one to three cubes to a solve state, some naming
+ * the same cube twice, some off the grid and some leaving the letter as it
+ * was, and checks after each that the state agrees with solving the grid
+ * afresh
+ */
+static unsigned int gniggle_solve_check_state(struct gniggle_dictionary *dict,
+				char *grid, unsigned int width,
+				unsigned int height, unsigned int changes)
+{
+	struct gniggle_solve_state *state;
+	unsigned int cubes[3], i, j, k, n, count, got, bad = 0;
+	char letters[3], *fresh;
+	uint32_t *ids, *want;
+
+	state = gniggle_solve_state_new(dict, grid, width, height);
+	fresh = gniggle_solve_random(width, height);
+
+	for (i = 0; i < changes; i++) {
+		n = 1 + rand() % 3;
+		for (j = 0; j < n; j++) {
+			cubes[j] = rand() % (width * height + 1);
+			if (j > 0 && rand() % 4 == 0)
+				cubes[j] = cubes[j - 1];
+			letters[j] = fresh[rand() % (width * height)];
+			if (cubes[j] < width * height && rand() % 4 == 0)
+				letters[j] = grid[cubes[j]];
+		}
+		for (j = 0; j < n; j++)
+			if (cubes[j] < width * height)
+				grid[cubes[j]] = letters[j];
+
+		got = gniggle_solve_state_change(state, cubes, letters, n);
+		want = gniggle_solve_grid_ids(dict, grid, width, height,
+						&count);
+		ids = gniggle_solve_state_ids(state, &k);
+
+		if (got != count || k != count ||
+			gniggle_solve_state_count(state) != count ||
+			memcmp(ids, want, count * sizeof(uint32_t)) != 0 ||
+			strcmp(gniggle_solve_state_grid(state), grid) != 0) {
+			printf("%ux%u change %u: state has %u words, "
+				"grid has %u\n", width, height, i, k, count);
+			bad++;
+		}
+		for (j = 0; j < count; j++)
+			if (gniggle_solve_state_found(state, want[j]) == false)
+				bad++;
+
+		free(ids);
+		free(want);
+	}
+
+	free(fresh);
+	gniggle_solve_state_delete(state);
+
+	return bad;
+}
+
+int main(int argc, char *argv[])
+{
+	struct gniggle_dictionary *dict;
+	unsigned int width, height, s, k, bad = 0;
+	unsigned int path[BUFSIZ * 2];
+	char word[BUFSIZ], *grid;
+
+	if (argc == 4) {
+		width = (unsigned int)atoi(argv[1]);
+		height = (unsigned int)atoi(argv[2]);
+		grid = argv[3];
+
+		while (scanf("%s", word) == 1) {
+			unsigned int i;
+			if (gniggle_solve_word_on_grid(word, grid, width,
+				height, path) == false)
+				continue;
+			printf("%s", word);
+			for (i = 0; word[i] != '\0'; i++)
+				printf(" %u,%u", path[i * 2], path[i * 2 + 1]);
+			printf("\n");
+		}
+
+		return 0;
+	}
+
+	dict = gniggle_dictionary_new_trie(100, 100);
+	while (scanf("%s", word) == 1)
+		gniggle_dictionary_add(dict, word);
+	srand(1);
+
+	for (s = 0; gniggle_solve_shapes[s][0] != 0; s++) {
+		width = gniggle_solve_shapes[s][0];
+		height = gniggle_solve_shapes[s][1];
+
+		for (k = 0; k < 4; k++) {
+			grid = gniggle_solve_random(width, height);
+			bad += gniggle_solve_check_words(dict, grid, width,
+								height);
+			bad += gniggle_solve_check_state(dict, grid, width,
+								height, 50);
+			bad += gniggle_solve_check_lists(dict, grid, width,
+								height);
+			free(grid);
+		}
+	}
+
+	bad += gniggle_solve_check_frontier();
+
+	printf("%u words, %u problems\n", gniggle_dictionary_size(dict), bad);
+	gniggle_dictionary_delete(dict);
+
+	return bad == 0 ? 0 : 1;
+}
+#endif
+
+#ifdef BENCHMARK
+#include <stdio.h>
+#include <time.h>
+#include "generate.h"
+
+/* solves random boards of increasing size, to show how the solver scales.
+ * Boards up to 64 cubes use the bitboard, and bigger ones the stack.  Then
+ * it shows how much cheaper a solve state makes changing a single cube, and
+ * how much sharing prefixes saves when checking a sorted word list.
+ */
+int main(int argc, char *argv[])
+{
+	static const unsigned int sizes[] = {
+		4, 5, 6, 8, 10, 16, 20, 32, 50, 64, 100, 0
+	};
+	const char *file = (argc > 1) ? argv[1] : "/usr/share/dict/words";
+	unsigned int boards = (argc > 2) ? atoi(argv[2]) : 20;
+	struct gniggle_dictionary *dict;
+	struct gniggle_solve_scratch *scratch;
+	struct timespec then, now;
+	const uint32_t *ids;
+	const char **list;
+	unsigned char *results;
+	unsigned int s, i, words;
+	char *text;
+	double secs;
+	size_t memory;
+
+	dict = gniggle_dictionary_new_trie_from_file(100, 100, file);
+	if (dict == NULL) {
+		fprintf(stderr, "unable to open %s\n", file);
+		return 1;
+	}
+
+	printf("%7s %10s %10s %10s %10s\n", "board", "ms/board", "us/cube",
+		"words", "bytes");
+
+	for (s = 0; sizes[s] != 0; s++) {
+		char **grids = malloc(boards * sizeof(char *));
+		unsigned int cubes = sizes[s] * sizes[s];
+
+		for (i = 0; i < boards; i++)
+			grids[i] = gniggle_generate_simple(GNIGGLE_BOGGLE,
+						sizes[s], sizes[s]);
+
+		scratch = gniggle_solve_scratch_new(dict, sizes[s], sizes[s]);
+		memory = gniggle_dictionary_size(dict) / 8 + 1;
+		if (scratch->w.board == NULL)
+			memory += (cubes / 64 + 1) * sizeof(uint64_t) +
+				scratch->w.depth *
+					sizeof(struct gniggle_solve_frame);
+
+		words = 0;
+		clock_gettime(CLOCK_MONOTONIC, &then);
+		for (i = 0; i < boards; i++)
+			words += gniggle_solve_grid_scratch(scratch, grids[i],
+								&ids);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		secs = (now.tv_sec - then.tv_sec) +
+			(now.tv_nsec - then.tv_nsec) / 1e9;
+		printf("%3ux%-3u %10.3f %10.3f %10u %10lu\n", sizes[s],
+			sizes[s], secs * 1e3 / boards,
+			secs * 1e6 / boards / cubes, words / boards,
+			(unsigned long)memory);
+
+		gniggle_solve_scratch_delete(scratch);
+		for (i = 0; i < boards; i++)
+			free(grids[i]);
+		free(grids);
+	}
+
+	/* then compare changing one cube of a solve state with solving the
+	 * whole board again
+	 */
+	printf("\n%7s %10s %10s %10s\n", "board", "us/full", "us/change",
+		"speedup");
+
+	for (s = 0; sizes[s] != 0; s++) {
+		unsigned int cubes = sizes[s] * sizes[s];
+		char *grid = gniggle_generate_simple(GNIGGLE_BOGGLE,
+						sizes[s], sizes[s]);
+		struct gniggle_solve_state *state;
+		unsigned int changes = boards * 10, cube;
+		char letter;
+		double full;
+
+		scratch = gniggle_solve_scratch_new(dict, sizes[s], sizes[s]);
+		clock_gettime(CLOCK_MONOTONIC, &then);
+		for (i = 0; i < boards; i++)
+			gniggle_solve_grid_scratch(scratch, grid, &ids);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		full = ((now.tv_sec - then.tv_sec) +
+			(now.tv_nsec - then.tv_nsec) / 1e9) / boards;
+		gniggle_solve_scratch_delete(scratch);
+
+		state = gniggle_solve_state_new(dict, grid, sizes[s], sizes[s]);
+		clock_gettime(CLOCK_MONOTONIC, &then);
+		for (i = 0; i < changes; i++) {
+			/* change a cube to another letter, then change it back */
+			cube = (i / 2 * 7919) % cubes;
+			letter = 'a' + (grid[cube] - 'a' + 1 + i % 25) % 26;
+			gniggle_solve_state_change(state, &cube,
+				(i & 1) ? &grid[cube] : &letter, 1);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		secs = ((now.tv_sec - then.tv_sec) +
+			(now.tv_nsec - then.tv_nsec) / 1e9) / changes;
+		gniggle_solve_state_delete(state);
+
+		printf("%3ux%-3u %10.3f %10.3f %9.1fx\n", sizes[s], sizes[s],
+			full * 1e6, secs * 1e6, full / secs);
+
+		free(grid);
+	}
+
+	/* and looking for every word in the dictionary in order, plainly and
+	 * then sharing prefixes, the way a word list would be checked
+	 */
+	printf("\n%7s %10s %10s %10s\n", "board", "ms/plain", "ms/sorted",
+		"speedup");
+
+	words = gniggle_dictionary_size(dict);
+	list = malloc(words * sizeof(char *));
+	text = malloc(words * (gniggle_dictionary_maxlen(dict) + 1));
+	results = malloc(words / 8 + 1);
+	for (i = 0; i < words; i++)
+		list[i] = gniggle_dictionary_word(dict, i,
+			text + i * (gniggle_dictionary_maxlen(dict) + 1));
+
+	for (s = 0; sizes[s] != 0; s++) {
+		char *grid = gniggle_generate_simple(GNIGGLE_BOGGLE,
+						sizes[s], sizes[s]);
+		double plain;
+
+		clock_gettime(CLOCK_MONOTONIC, &then);
+		gniggle_solve_words_on_grid(list, words, grid, sizes[s],
+						sizes[s], results, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		plain = (now.tv_sec - then.tv_sec) +
+			(now.tv_nsec - then.tv_nsec) / 1e9;
+
+		clock_gettime(CLOCK_MONOTONIC, &then);
+		gniggle_solve_sorted_words_on_grid(list, words, grid,
+					sizes[s], sizes[s], results, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		secs = (now.tv_sec - then.tv_sec) +
+			(now.tv_nsec - then.tv_nsec) / 1e9;
+
+		printf("%3ux%-3u %10.3f %10.3f %9.1fx\n", sizes[s], sizes[s],
+			plain * 1e3, secs * 1e3, plain / secs);
+
+		free(grid);
+	}
+
+	free(results);
+	free(text);
+	free(list);
+	gniggle_dictionary_delete(dict);
+
 	return 0;
 }
 #endif
@@ -31,20 +31,221 @@
 
 /* returns true if there are sufficent letters on the grid for a specific
  * word.  It does not check if the word is a valid play, simply if it's
- * possible for it to be so
+ * possible for it to be so.  If you are checking a lot of words against
+ * one grid, compare letter signatures (see dictionary.h) first, working
+ * out the grid's just once.
  */
 bool gniggle_solve_sufficent_letters(const char *word, const char *grid);
 
 /* returns true if 'word' is on the grid represented by the string 'grid'.  The
- * grid string is a character per cube, left to right, top to bottom.  If you
- * also want to know the route of the found word, pass in a pointer to an
- * array of integers that has at least enough room for two integer per letter
- * in your word.  This will be filled in with co-ordinates, even numbered
- * entries being x, and odd being y.  If you're not interested, just pass NULL.
+ * grid string is a character per cube, left to right, top to bottom, and
+ * the grid may be any shape.  If you also want to know the route of the
+ * found word, pass in a pointer to an array of integers that has at least
+ * enough room for two integer per letter in your word.  This will be filled
+ * in with co-ordinates counting from one, even numbered entries being x (the
+ * column), and odd being y (the row).  If you're not interested, just pass
+ * NULL.
  */
 bool gniggle_solve_word_on_grid(const char *word,
 				const char *grid,
 				const unsigned int width,
 				const unsigned int height,
 				unsigned int *path);
+
+/* checks many words against one grid, which is only prepared once.  Bit i
+ * of 'results' (bit i % 8 of byte i / 8) is set if words[i] is on the grid,
+ * and 'results' must have room for nwords / 8 + 1 bytes.  If 'paths' is not
+ * NULL, it is an array of 'nwords' pointers, each either NULL or room for a
+ * word's route as for gniggle_solve_word_on_grid().  Returns the number of
+ * words found.
+ */
+unsigned int gniggle_solve_words_on_grid(const char **words,
+				const unsigned int nwords,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned char *results,
+				unsigned int **paths);
+
+/* as gniggle_solve_words_on_grid(), but takes each word's letter signature
+ * (see dictionary.h) from 'sigs' rather than working it out, for callers
+ * that already have them, such as from gniggle_dictionary_next_signature().
+ * Words are then ruled out by their letters many at a time.
+ */
+unsigned int gniggle_solve_signed_words_on_grid(const char **words,
+				const unsigned int *sigs,
+				const unsigned int nwords,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned char *results,
+				unsigned int **paths);
+
+/* as gniggle_solve_words_on_grid(), but shares the work of finding the
+ * letters a word has in common with the word before it.  Any order of words
+ * works, but sorted ones share the most, so this is the one to use for a
+ * sorted list.  The route given for a word may differ from the one
+ * gniggle_solve_word_on_grid() would give, but is just as valid.
+ */
+unsigned int gniggle_solve_sorted_words_on_grid(const char **words,
+				const unsigned int nwords,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned char *results,
+				unsigned int **paths);
+
+/* returns every word in 'dict' that can be found on the grid, as a sorted
+ * array terminated by NULL.  The words are stored in the same block as the
+ * array, so it should be freed with a single call to free().  Rather than
+ * trying each word in turn, this walks outwards from every cube and gives up
+ * on a route as soon as no word starts with the letters along it.  Boards
+ * of any size may be solved; beyond 64 cubes, the memory needed grows only
+ * with the number of cubes and the length of the longest word, and nothing
+ * recurses.  "make bench" builds a program that shows how the time taken
+ * grows with the size of the board.
+ */
+const char **gniggle_solve_grid(struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height);
+
+/* as gniggle_solve_grid(), but returns the IDs of the words found (see
+ * dictionary.h) in ascending order, which is also alphabetical order.  The
+ * number of them is stored in 'count', and the array should be freed with
+ * free().
+ */
+uint32_t *gniggle_solve_grid_ids(struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned int *count);
+
+/* as gniggle_solve_grid_ids(), but shares the work out between 'threads'
+ * threads, or one per processor if it is zero.  The answer is just the same
+ * as with one thread.  Nothing else may change the dictionary while this
+ * runs, but other threads may read it.
+ */
+uint32_t *gniggle_solve_grid_ids_threaded(struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned int threads,
+				unsigned int *count);
+
+/* as gniggle_solve_grid(), but shares the work out between threads as
+ * gniggle_solve_grid_ids_threaded() does
+ */
+const char **gniggle_solve_grid_threaded(struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				unsigned int threads);
+
+/* Solving many grids one after another can reuse the same memory, set up
+ * once for a dictionary and a grid size.  A scratch area may only be used
+ * by one thread at a time, but each thread can have its own.  The
+ * dictionary must not change while a scratch area for it exists.
+ */
+struct gniggle_solve_scratch;
+
+/* creates a scratch area for solving grids of the given size */
+struct gniggle_solve_scratch *gniggle_solve_scratch_new(
+				struct gniggle_dictionary *dict,
+				const unsigned int width,
+				const unsigned int height);
+
+/* as gniggle_solve_grid_ids(), but using a scratch area, so nothing is
+ * allocated once the scratch area has grown to fit.  Returns the number of
+ * words found, and sets 'ids' to their IDs in ascending order.  The array
+ * belongs to the scratch area, and is overwritten by the next grid.
+ */
+unsigned int gniggle_solve_grid_scratch(struct gniggle_solve_scratch *scratch,
+				const char *grid,
+				const uint32_t **ids);
+
+/* deletes a scratch area */
+void gniggle_solve_scratch_delete(struct gniggle_solve_scratch *scratch);
+
+/* the words on a grid, along with the routes that spell them out.  A route
+ * is a run of cube numbers, one per letter, where a cube's number is its
+ * row times the grid's width plus its column.  Every route for a word has
+ * the same number of cubes, and a word's routes follow one another.
+ */
+struct gniggle_solve_routes {
+	unsigned int count;		/* number of words */
+	uint32_t *ids;			/* their IDs, in ascending order */
+	unsigned int *length;		/* cubes in each word's routes */
+	unsigned int *routes;		/* number of routes for each word */
+	unsigned int *start;		/* where each word's routes start in
+					 * cubes, with one more entry giving
+					 * the total */
+	uint16_t *cubes;		/* all the routes */
+};
+
+/* as gniggle_solve_grid_ids(), but also keeps the routes taken to find the
+ * words, as it goes, so there is no need to look for each word again
+ * afterwards.  If 'every' is false, one route is kept for each word,
+ * otherwise every route is.  Returns NULL if the grid has more than 65536
+ * cubes.
+ */
+struct gniggle_solve_routes *gniggle_solve_grid_routes(
+				struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height,
+				bool every);
+
+/* deletes routes returned by gniggle_solve_grid_routes() */
+void gniggle_solve_routes_delete(struct gniggle_solve_routes *routes);
+
+/* A solve state keeps a grid's answers up to date as its cubes are changed,
+ * one or a few at a time, such as when searching for a good grid.  Only the
+ * routes that went through a changed cube, or could now, are looked at
+ * again, so a change costs a small part of solving the grid afresh.  It
+ * keeps every route that spells the start of a word, which takes far more
+ * memory than solving the grid once, so it is best kept to small grids.
+ * The dictionary must not change while a state for it exists.
+ */
+struct gniggle_solve_state;
+
+/* creates a solve state for a grid, which is copied, and solves it */
+struct gniggle_solve_state *gniggle_solve_state_new(
+				struct gniggle_dictionary *dict,
+				const char *grid,
+				const unsigned int width,
+				const unsigned int height);
+
+/* sets the 'n' cubes numbered in 'cubes' to the matching letters in
+ * 'letters', and brings the answers up to date.  Cubes are numbered as in
+ * gniggle_solve_grid_routes().  Returns the number of words now found.  To
+ * undo a change, change the cubes back.
+ */
+unsigned int gniggle_solve_state_change(struct gniggle_solve_state *state,
+				const unsigned int *cubes,
+				const char *letters,
+				unsigned int n);
+
+/* returns the number of words found on the grid as it is now */
+unsigned int gniggle_solve_state_count(struct gniggle_solve_state *state);
+
+/* returns true if the word with the given ID is on the grid */
+bool gniggle_solve_state_found(struct gniggle_solve_state *state,
+				uint32_t id);
+
+/* returns the IDs of the words on the grid in ascending order, as
+ * gniggle_solve_grid_ids() would, and stores the number of them in 'count'.
+ * The array should be freed with free().
+ */
+uint32_t *gniggle_solve_state_ids(struct gniggle_solve_state *state,
+				unsigned int *count);
+
+/* returns the grid as it is now, which belongs to the state */
+const char *gniggle_solve_state_grid(struct gniggle_solve_state *state);
+
+/* returns the number of bytes a solve state uses */
+size_t gniggle_solve_state_memory(struct gniggle_solve_state *state);
+
+/* deletes a solve state */
+void gniggle_solve_state_delete(struct gniggle_solve_state *state);
 #endif /* __SOLVE_H__ */
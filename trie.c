@@ -0,0 +1,639 @@
+/*
+ * trie.c
+ * This file is part of Gniggle
+ *
+ * Copyright (C) 2006 - Rob Kendrick <rjek@rjek.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <malloc.h>
+#include "trie.h"
+
+/* each node is two words.  The first holds the letter in its bottom five
+ * bits, a terminal flag in bit five and the index of the first child in the
+ * rest.  The second is the index of the next sibling.  An index of zero
+ * means "none", which is safe as nothing can point back at the root.  The
+ * words are always stored little-endian, so that the array can be written
+ * out and later used in place on any machine.  As the array may come from
+ * a file, a link past the end of it is taken as "none" too, and a sibling
+ * list is never followed for more letters than there are.
+ */
+struct gniggle_trie {
+	uint32_t *nodes;		/* node array, two words per node */
+	unsigned int nnodes;		/* number of nodes in use */
+	unsigned int size;		/* number of nodes allocated */
+	unsigned int maxlen;		/* length of the longest word */
+	bool minimised;			/* tails may be shared */
+	bool borrowed;			/* nodes belong to someone else */
+	uint32_t *counts;		/* words below each node, or NULL */
+	bool borrowedcounts;		/* counts belong to someone else */
+};
+
+struct gniggle_trie_iter {
+	const struct gniggle_trie *trie;/* trie we're iterating */
+	unsigned int depth;		/* length of the current word */
+	bool done;			/* no more words */
+	unsigned int *stack;		/* node for each letter of word */
+	char *word;			/* current word */
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LE32(x) __builtin_bswap32(x)
+#else
+#define LE32(x) (x)
+#endif
+
+#define W0(t, n) LE32((t)->nodes[(n) * 2])
+#define W1(t, n) LE32((t)->nodes[(n) * 2 + 1])
+#define SET_W0(t, n, v) ((t)->nodes[(n) * 2] = LE32(v))
+#define SET_W1(t, n, v) ((t)->nodes[(n) * 2 + 1] = LE32(v))
+
+#define LETTER(t, n) (W0(t, n) & 31)
+#define TERMINAL(t, n) ((W0(t, n) >> 5) & 1)
+#define LINK(t, i) ((i) < (t)->nnodes ? (i) : 0)
+#define CHILD(t, n) LINK(t, W0(t, n) >> 6)
+#define SIBLING(t, n) LINK(t, W1(t, n))
+
+#define SET_CHILD(t, n, c) SET_W0(t, n, \
+		((uint32_t)(c) << 6) | (W0(t, n) & 63))
+#define SET_TERMINAL(t, n) SET_W0(t, n, W0(t, n) | 32)
+
+/* the number of words spelt through the sibling list starting at 'n' */
+#define BELOW(t, n) ((n) == 0 ? 0 : (t)->counts[n])
+
+struct gniggle_trie *gniggle_trie_new(void)
+{
+	struct gniggle_trie *r = calloc(sizeof(struct gniggle_trie), 1);
+
+	r->size = 64;
+	r->nodes = calloc(sizeof(uint32_t) * 2, r->size);
+	r->nnodes = 1;
+
+	return r;
+}
+
+struct gniggle_trie *gniggle_trie_new_static(const void *nodes,
+					unsigned int nnodes,
+					unsigned int maxlen,
+					const uint32_t *counts)
+{
+	struct gniggle_trie *r = calloc(sizeof(struct gniggle_trie), 1);
+
+	/* the nodes are never written through this pointer; adding a word
+	 * copies them first
+	 */
+	r->nodes = (uint32_t *)nodes;
+	r->nnodes = nnodes;
+	r->size = nnodes;
+	r->maxlen = maxlen;
+	r->minimised = true;
+	r->borrowed = true;
+	r->counts = (uint32_t *)counts;
+	r->borrowedcounts = counts != NULL;
+
+	return r;
+}
+
+/* throws away the word counts, which are no longer right */
+static void gniggle_trie_forget_counts(struct gniggle_trie *trie)
+{
+	if (trie->borrowedcounts == false)
+		free(trie->counts);
+	trie->counts = NULL;
+	trie->borrowedcounts = false;
+}
+
+void gniggle_trie_delete(struct gniggle_trie *trie)
+{
+	if (trie->borrowed == false)
+		free(trie->nodes);
+	gniggle_trie_forget_counts(trie);
+	free(trie);
+}
+
+static unsigned int gniggle_trie_alloc(struct gniggle_trie *trie,
+					unsigned int letter,
+					unsigned int sibling)
+{
+	unsigned int n;
+
+	if (trie->nnodes == trie->size) {
+		trie->size *= 2;
+		trie->nodes = realloc(trie->nodes,
+				trie->size * sizeof(uint32_t) * 2);
+	}
+
+	n = trie->nnodes++;
+	SET_W0(trie, n, letter);
+	SET_W1(trie, n, sibling);
+
+	return n;
+}
+
+/* replaces a minimised trie with an unshared copy so that it can be safely
+ * added to again
+ */
+static void gniggle_trie_expand(struct gniggle_trie *trie)
+{
+	struct gniggle_trie *n = gniggle_trie_new();
+	struct gniggle_trie_iter *iter = gniggle_trie_iterator(trie);
+	const char *word;
+
+	while ((word = gniggle_trie_next(iter)) != NULL)
+		gniggle_trie_add(n, word);
+
+	gniggle_trie_iterator_delete(iter);
+
+	if (trie->borrowed == false)
+		free(trie->nodes);
+	*trie = *n;
+	free(n);
+}
+
+bool gniggle_trie_add(struct gniggle_trie *trie, const char *word)
+{
+	unsigned int node = 0, len = 0;
+	const char *p;
+
+	if (word[0] == '\0')
+		return false;
+
+	for (p = word; *p != '\0'; p++)
+		if (*p < 'a' || *p > 'z')
+			return false;
+
+	gniggle_trie_forget_counts(trie);
+
+	if (trie->minimised == true)
+		gniggle_trie_expand(trie);
+
+	for (p = word; *p != '\0'; p++, len++) {
+		unsigned int c = *p - 'a';
+		unsigned int prev = 0, n = CHILD(trie, node);
+
+		while (n != 0 && LETTER(trie, n) < c) {
+			prev = n;
+			n = SIBLING(trie, n);
+		}
+
+		if (n == 0 || LETTER(trie, n) != c) {
+			unsigned int new = gniggle_trie_alloc(trie, c, n);
+			if (prev == 0)
+				SET_CHILD(trie, node, new);
+			else
+				SET_W1(trie, prev, new);
+			n = new;
+		}
+
+		node = n;
+	}
+
+	if (TERMINAL(trie, node))
+		return false;
+
+	SET_TERMINAL(trie, node);
+	if (len > trie->maxlen)
+		trie->maxlen = len;
+
+	return true;
+}
+
+bool gniggle_trie_remove(struct gniggle_trie *trie, const char *word)
+{
+	unsigned int *path, depth = 0;
+	size_t len = strlen(word);
+	bool r = false;
+
+	if (word[0] == '\0' || gniggle_trie_lookup(trie, word) == false)
+		return false;
+
+	gniggle_trie_forget_counts(trie);
+
+	if (trie->minimised == true)
+		gniggle_trie_expand(trie);
+
+	path = malloc(sizeof(unsigned int) * (len + 1));
+	path[0] = 0;
+	while (depth < len) {
+		path[depth + 1] = gniggle_trie_child(trie, path[depth],
+							word[depth]);
+		depth++;
+	}
+
+	if (TERMINAL(trie, path[depth])) {
+		SET_W0(trie, path[depth], W0(trie, path[depth]) & ~32u);
+		r = true;
+	}
+
+	/* unhook any nodes left leading nowhere.  They stay in the array
+	 * until the trie is next minimised.
+	 */
+	while (depth > 0 && TERMINAL(trie, path[depth]) == 0 &&
+		CHILD(trie, path[depth]) == 0) {
+		unsigned int n = path[depth], parent = path[depth - 1];
+
+		if (CHILD(trie, parent) == n) {
+			SET_CHILD(trie, parent, SIBLING(trie, n));
+		} else {
+			unsigned int prev = CHILD(trie, parent);
+			while (SIBLING(trie, prev) != n)
+				prev = SIBLING(trie, prev);
+			SET_W1(trie, prev, SIBLING(trie, n));
+		}
+
+		depth--;
+	}
+
+	free(path);
+
+	return r;
+}
+
+unsigned int gniggle_trie_child(const struct gniggle_trie *trie,
+				unsigned int node, char letter)
+{
+	unsigned int c = letter - 'a';
+	unsigned int n = CHILD(trie, node), i;
+
+	if (letter < 'a' || letter > 'z')
+		return 0;
+
+	for (i = 0; n != 0 && LETTER(trie, n) < c && i < 26; i++)
+		n = SIBLING(trie, n);
+
+	if (n != 0 && LETTER(trie, n) == c)
+		return n;
+
+	return 0;
+}
+
+bool gniggle_trie_terminal(const struct gniggle_trie *trie,
+				unsigned int node)
+{
+	return TERMINAL(trie, node) != 0;
+}
+
+/* returns the node reached by following 'word' from the root, or zero */
+static unsigned int gniggle_trie_walk(const struct gniggle_trie *trie,
+					const char *word)
+{
+	unsigned int node = 0;
+
+	while (*word != '\0') {
+		node = gniggle_trie_child(trie, node, *word++);
+		if (node == 0)
+			return 0;
+	}
+
+	return node;
+}
+
+bool gniggle_trie_lookup(const struct gniggle_trie *trie, const char *word)
+{
+	unsigned int node;
+
+	if (word[0] == '\0')
+		return false;
+
+	node = gniggle_trie_walk(trie, word);
+
+	return node != 0 && TERMINAL(trie, node);
+}
+
+bool gniggle_trie_lookup_prefix(const struct gniggle_trie *trie,
+				const char *prefix)
+{
+	if (prefix[0] == '\0')
+		return CHILD(trie, 0) != 0;
+
+	return gniggle_trie_walk(trie, prefix) != 0;
+}
+
+unsigned int gniggle_trie_nodes(const struct gniggle_trie *trie)
+{
+	return trie->nnodes;
+}
+
+size_t gniggle_trie_memory(const struct gniggle_trie *trie, size_t *shared)
+{
+	size_t r = sizeof(struct gniggle_trie);
+	size_t nodes = sizeof(uint32_t) * 2 *
+		(trie->borrowed == true ? trie->nnodes : trie->size);
+	size_t counts = (trie->counts == NULL) ? 0 :
+		sizeof(uint32_t) * trie->nnodes;
+
+	*shared = 0;
+	if (trie->borrowed == true)
+		*shared += nodes;
+	else
+		r += nodes;
+	if (trie->borrowedcounts == true)
+		*shared += counts;
+	else
+		r += counts;
+
+	return r;
+}
+
+unsigned int gniggle_trie_maxlen(const struct gniggle_trie *trie)
+{
+	return trie->maxlen;
+}
+
+const void *gniggle_trie_data(const struct gniggle_trie *trie)
+{
+	return trie->nodes;
+}
+
+/* state used while minimising: the new node array, and a hash table of the
+ * nodes already in it so that duplicates can be found
+ */
+struct gniggle_trie_cons {
+	uint32_t *out;			/* new node array */
+	unsigned int nout;		/* nodes in the new array */
+	uint32_t *table;		/* indices into out, or zero */
+	unsigned int mask;		/* table size - 1 */
+};
+
+static unsigned int gniggle_trie_intern(struct gniggle_trie_cons *c,
+					uint32_t w0, uint32_t w1)
+{
+	unsigned int h = ((w0 * 0x9e3779b1u) ^ (w1 * 0x85ebca6bu)) & c->mask;
+
+	while (c->table[h] != 0) {
+		uint32_t n = c->table[h];
+		if (c->out[n * 2] == LE32(w0) && c->out[n * 2 + 1] == LE32(w1))
+			return n;
+		h = (h + 1) & c->mask;
+	}
+
+	c->out[c->nout * 2] = LE32(w0);
+	c->out[c->nout * 2 + 1] = LE32(w1);
+	c->table[h] = c->nout;
+
+	return c->nout++;
+}
+
+/* returns the new index of the sibling list starting at 'node'.  A node is
+ * the same as another if it has the same letter and flag, and its child and
+ * sibling lists are the same, so they are resolved first.  Siblings are done
+ * from the end of the list, so recursion only goes as deep as the longest
+ * word.
+ */
+static unsigned int gniggle_trie_canon(const struct gniggle_trie *trie,
+					struct gniggle_trie_cons *c,
+					unsigned int node)
+{
+	unsigned int chain[26], n, i = 0, next = 0;
+
+	for (n = node; n != 0; n = SIBLING(trie, n))
+		chain[i++] = n;
+
+	while (i-- > 0) {
+		uint32_t child = gniggle_trie_canon(trie, c,
+						CHILD(trie, chain[i]));
+		uint32_t w0 = (child << 6) | (W0(trie, chain[i]) & 63);
+		next = gniggle_trie_intern(c, w0, next);
+	}
+
+	return next;
+}
+
+void gniggle_trie_minimise(struct gniggle_trie *trie)
+{
+	struct gniggle_trie_cons c;
+	unsigned int tsize = 1, root;
+
+	if (trie->minimised == true)
+		return;
+
+	while (tsize < trie->nnodes * 2)
+		tsize <<= 1;
+
+	c.out = calloc(sizeof(uint32_t) * 2, trie->nnodes);
+	c.nout = 1;
+	c.table = calloc(sizeof(uint32_t), tsize);
+	c.mask = tsize - 1;
+
+	root = gniggle_trie_canon(trie, &c, CHILD(trie, 0));
+	c.out[0] = LE32((uint32_t)root << 6);
+	c.out[1] = 0;
+
+	free(c.table);
+	if (trie->borrowed == false)
+		free(trie->nodes);
+	gniggle_trie_forget_counts(trie);
+
+	trie->nodes = realloc(c.out, sizeof(uint32_t) * 2 * c.nout);
+	trie->nnodes = c.nout;
+	trie->size = c.nout;
+	trie->minimised = true;
+}
+
+/* fills in the counts for the sibling list starting at 'node', and returns
+ * the number of words spelt through it.  Like gniggle_trie_canon(), siblings
+ * are done from the end of the list.  Nodes shared by a minimised trie are
+ * only counted once.
+ */
+static uint32_t gniggle_trie_count_list(struct gniggle_trie *trie,
+					unsigned int node)
+{
+	unsigned int chain[26], n, i = 0;
+	uint32_t total = 0;
+
+	for (n = node; n != 0 && trie->counts[n] == UINT32_MAX && i < 26;
+		n = SIBLING(trie, n))
+		chain[i++] = n;
+
+	if (n != 0 && trie->counts[n] != UINT32_MAX)
+		total = trie->counts[n];
+
+	/* nothing below these can lead back to them in a real trie, but
+	 * marking them now stops a looping one from recursing forever
+	 */
+	for (n = 0; n < i; n++)
+		trie->counts[chain[n]] = 0;
+
+	while (i-- > 0) {
+		n = chain[i];
+		total += TERMINAL(trie, n) +
+			gniggle_trie_count_list(trie, CHILD(trie, n));
+		trie->counts[n] = total;
+	}
+
+	return total;
+}
+
+unsigned int gniggle_trie_count(struct gniggle_trie *trie)
+{
+	if (trie->counts == NULL) {
+		trie->counts = malloc(sizeof(uint32_t) * trie->nnodes);
+		memset(trie->counts, 0xff, sizeof(uint32_t) * trie->nnodes);
+		trie->counts[0] = gniggle_trie_count_list(trie,
+						CHILD(trie, 0));
+	}
+
+	return trie->counts[0];
+}
+
+const uint32_t *gniggle_trie_counts(struct gniggle_trie *trie)
+{
+	gniggle_trie_count(trie);
+
+	return trie->counts;
+}
+
+unsigned int gniggle_trie_words_from(const struct gniggle_trie *trie,
+					unsigned int node)
+{
+	if (node == 0)
+		return trie->counts[0];
+
+	return TERMINAL(trie, node) + BELOW(trie, CHILD(trie, node));
+}
+
+unsigned int gniggle_trie_step(const struct gniggle_trie *trie,
+				unsigned int node, char letter,
+				unsigned int *skip)
+{
+	unsigned int c = letter - 'a';
+	unsigned int n = CHILD(trie, node), i;
+
+	if (letter < 'a' || letter > 'z') {
+		*skip = 0;
+		return 0;
+	}
+
+	for (i = 0; n != 0 && LETTER(trie, n) < c && i < 26; i++)
+		n = SIBLING(trie, n);
+
+	*skip = TERMINAL(trie, node) + BELOW(trie, CHILD(trie, node)) -
+		BELOW(trie, n);
+
+	if (n != 0 && LETTER(trie, n) == c)
+		return n;
+
+	return 0;
+}
+
+void gniggle_trie_word(const struct gniggle_trie *trie, unsigned int rank,
+			char *word)
+{
+	unsigned int node = 0, n, i, depth = 0;
+
+	while ((node == 0 || TERMINAL(trie, node) == 0 || rank-- > 0) &&
+		depth++ < trie->maxlen) {
+		for (n = CHILD(trie, node), i = 0; n != 0 && i < 26;
+			n = SIBLING(trie, n), i++) {
+			uint32_t here = trie->counts[n] -
+					BELOW(trie, SIBLING(trie, n));
+			if (rank < here)
+				break;
+			rank -= here;
+		}
+
+		if (n == 0)
+			break;
+
+		*word++ = 'a' + LETTER(trie, n);
+		node = n;
+	}
+
+	*word = '\0';
+}
+
+struct gniggle_trie_iter *gniggle_trie_iterator(
+				const struct gniggle_trie *trie)
+{
+	struct gniggle_trie_iter *r = calloc(
+				sizeof(struct gniggle_trie_iter), 1);
+
+	r->trie = trie;
+	r->stack = calloc(sizeof(unsigned int), trie->maxlen + 1);
+	r->word = calloc(trie->maxlen + 1, 1);
+
+	return r;
+}
+
+/* returns the sibling after 'n', or zero if there is none or it is out of
+ * order, which would otherwise let a damaged trie be iterated forever
+ */
+static unsigned int gniggle_trie_after(const struct gniggle_trie *trie,
+					unsigned int n)
+{
+	unsigned int s = SIBLING(trie, n);
+
+	return (s != 0 && LETTER(trie, s) > LETTER(trie, n)) ? s : 0;
+}
+
+/* moves to the next node in depth-first order, returning false once the
+ * whole trie has been visited
+ */
+static bool gniggle_trie_advance(struct gniggle_trie_iter *iter)
+{
+	const struct gniggle_trie *trie = iter->trie;
+	unsigned int n = iter->stack[iter->depth];
+
+	if (CHILD(trie, n) != 0 && iter->depth < trie->maxlen) {
+		iter->depth++;
+		iter->stack[iter->depth] = CHILD(trie, n);
+	} else {
+		while (iter->depth > 0 &&
+			gniggle_trie_after(trie, iter->stack[iter->depth]) ==
+				0)
+			iter->depth--;
+
+		if (iter->depth == 0)
+			return false;
+
+		iter->stack[iter->depth] =
+			gniggle_trie_after(trie, iter->stack[iter->depth]);
+	}
+
+	iter->word[iter->depth - 1] =
+		'a' + LETTER(trie, iter->stack[iter->depth]);
+	iter->word[iter->depth] = '\0';
+
+	return true;
+}
+
+const char *gniggle_trie_next(struct gniggle_trie_iter *iter)
+{
+	while (iter->done == false) {
+		if (gniggle_trie_advance(iter) == false) {
+			iter->done = true;
+			break;
+		}
+		if (TERMINAL(iter->trie, iter->stack[iter->depth]))
+			return iter->word;
+	}
+
+	return NULL;
+}
+
+void gniggle_trie_iterator_delete(struct gniggle_trie_iter *iter)
+{
+	free(iter->stack);
+	free(iter->word);
+	free(iter);
+}
@@ -0,0 +1,155 @@
+/*
+ * trie.h
+ * This file is part of Gniggle
+ *
+ * Copyright (C) 2006 - Rob Kendrick <rjek@rjek.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to
+ * do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __TRIE_H__
+#define __TRIE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A letter trie used by the dictionary code.  Nodes are kept in a single
+ * array, each with its first child and next sibling, and siblings are kept
+ * in alphabetical order.  Only the letters a to z may be stored.  Once
+ * minimised, identical tails are shared between words, turning the trie into
+ * a DAWG; adding to a minimised trie transparently unshares it first.
+ */
+
+struct gniggle_trie;
+struct gniggle_trie_iter;
+
+/* creates a new, empty trie */
+struct gniggle_trie *gniggle_trie_new(void);
+
+/* creates a trie that uses an existing node array in place, such as one
+ * written out from gniggle_trie_data() and mapped back in.  The array is
+ * not copied or freed, and is only read from.  The same goes for 'counts',
+ * which may be NULL, or what gniggle_trie_counts() gave for these nodes.
+ */
+struct gniggle_trie *gniggle_trie_new_static(const void *nodes,
+					unsigned int nnodes,
+					unsigned int maxlen,
+					const uint32_t *counts);
+
+/* deletes a trie and all its nodes */
+void gniggle_trie_delete(struct gniggle_trie *trie);
+
+/* adds a word to the trie.  Returns true if the word was not already
+ * present, false if it was or it contains something other than a to z.
+ */
+bool gniggle_trie_add(struct gniggle_trie *trie, const char *word);
+
+/* removes a word from the trie.  Returns true if it was there. */
+bool gniggle_trie_remove(struct gniggle_trie *trie, const char *word);
+
+/* returns true if 'word' is in the trie */
+bool gniggle_trie_lookup(const struct gniggle_trie *trie, const char *word);
+
+/* returns true if any word in the trie starts with 'prefix' */
+bool gniggle_trie_lookup_prefix(const struct gniggle_trie *trie,
+				const char *prefix);
+
+/* shares identical tails between words, which usually shrinks the trie a
+ * great deal.  Lookups are unaffected.
+ */
+void gniggle_trie_minimise(struct gniggle_trie *trie);
+
+/* returns the number of nodes in the trie, including the root */
+unsigned int gniggle_trie_nodes(const struct gniggle_trie *trie);
+
+/* returns the number of bytes the trie has allocated, including room kept
+ * for more nodes, and sets 'shared' to the size of any node array or counts
+ * it uses in place from elsewhere
+ */
+size_t gniggle_trie_memory(const struct gniggle_trie *trie, size_t *shared);
+
+/* returns the length of the longest word in the trie */
+unsigned int gniggle_trie_maxlen(const struct gniggle_trie *trie);
+
+/* returns the node array, which is gniggle_trie_nodes() pairs of
+ * little-endian 32 bit words
+ */
+const void *gniggle_trie_data(const struct gniggle_trie *trie);
+
+/* returns the child of 'node' reached by 'letter', or zero if there is
+ * none.  Node zero is the root.
+ */
+unsigned int gniggle_trie_child(const struct gniggle_trie *trie,
+				unsigned int node, char letter);
+
+/* returns true if a word ends at 'node' */
+bool gniggle_trie_terminal(const struct gniggle_trie *trie,
+				unsigned int node);
+
+/* works out how many words lie below each node, so that words can be
+ * found by their position in alphabetical order, or "rank".  Returns the
+ * number of words in the trie.  The counts are thrown away whenever the
+ * trie changes, and the functions below need them, so call this again
+ * after adding words or minimising.  Calling it when nothing has changed
+ * costs nothing.
+ */
+unsigned int gniggle_trie_count(struct gniggle_trie *trie);
+
+/* returns the counts worked out by gniggle_trie_count(), working them out
+ * first if need be.  There is one for each node, in the machine's own byte
+ * order.
+ */
+const uint32_t *gniggle_trie_counts(struct gniggle_trie *trie);
+
+/* returns the number of words that start with the letters spelt by 'node',
+ * including the one ending at it, if any
+ */
+unsigned int gniggle_trie_words_from(const struct gniggle_trie *trie,
+					unsigned int node);
+
+/* as gniggle_trie_child(), but also sets 'skip' to the number of words
+ * passed over on the way: the word ending at 'node', if any, and all the
+ * words through children with earlier letters.  This is set even if there
+ * is no child for the letter.  Adding it up along a word's letters gives
+ * the word's rank.
+ */
+unsigned int gniggle_trie_step(const struct gniggle_trie *trie,
+				unsigned int node, char letter,
+				unsigned int *skip);
+
+/* writes the word with the given rank into 'word', which must have room for
+ * gniggle_trie_maxlen() letters and a terminator
+ */
+void gniggle_trie_word(const struct gniggle_trie *trie, unsigned int rank,
+			char *word);
+
+/* create an iterator over the words in the trie, in alphabetical order */
+struct gniggle_trie_iter *gniggle_trie_iterator(
+				const struct gniggle_trie *trie);
+
+/* returns the next word, or NULL once all have been returned.  The string
+ * belongs to the iterator and is overwritten by the next call.
+ */
+const char *gniggle_trie_next(struct gniggle_trie_iter *iter);
+
+/* deletes an iterator */
+void gniggle_trie_iterator_delete(struct gniggle_trie_iter *iter);
+
+#endif /* __TRIE_H__ */